@@ -0,0 +1,26 @@
+# frozen_string_literal: true
+
+# Encoding and decoding big integers from 8 bytes (just
+# past the fixnum range) up to 1 MB, both of which should
+# grow linearly with the size of the integer.
+
+require 'benchmark/ips'
+require_relative '../lib/retf'
+
+SIZES = [8, 32, 256, 512, 4096, 65_536, 1_048_576].freeze
+
+INTEGERS = SIZES.to_h do |bytes|
+  int = (1 << ((bytes * 8) - 1)) | 0xDEADBEEF
+  [bytes, [int, Retf.encode(int).freeze]]
+end.freeze
+
+RubyVM::YJIT.enable
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  INTEGERS.each do |bytes, (int, encoded)|
+    x.report("encode #{bytes} bytes") { Retf.encode(int) }
+    x.report("decode #{bytes} bytes") { Retf.decode(encoded) }
+  end
+end
@@ -0,0 +1,63 @@
+# frozen_string_literal: true
+
+# Compares two reports written by bench/suite.rb and exits with a non-zero
+# status if the second one regressed: a path got slower by more than
+# BENCH_THRESHOLD percent (10 by default) with none of its samples as fast
+# as the slowest one in the baseline, or it allocates more objects per call.
+#
+#   ruby bench/compare.rb bench/results/baseline.json bench/results/latest.json
+
+require 'json'
+
+$stdout.sync = true
+
+BENCH_THRESHOLD = Float(ENV.fetch('BENCH_THRESHOLD', 10))
+
+def gcs_per_thousand(result)
+  (result['minor_gc_count'] + result['major_gc_count']) * 1000.0 / result['calls']
+end
+
+def change(before, after)
+  before.zero? ? 0.0 : (after - before) * 100.0 / before
+end
+
+# Why `after` counts as a regression of `before`, if it does
+def regressions(before, after)
+  slower = change(before['ips'], after['ips'])
+  allocated = after['objects_per_call'] - before['objects_per_call']
+
+  [
+    (format('%.1f%% slower', -slower) if slower < -BENCH_THRESHOLD && after['ips_max'] < before['ips_min']),
+    (format('%+.2f objects/call', allocated) if allocated >= 0.5)
+  ].compact
+end
+
+def report(label, before, after)
+  puts format('%-36s %12.1f i/s %+7.1f%% %10.1f objects/call %+8.2f %7.2f GCs/1k %+8.2f %8s KB peak RSS %+6.1f%%',
+              label, after['ips'], change(before['ips'], after['ips']),
+              after['objects_per_call'], after['objects_per_call'] - before['objects_per_call'],
+              gcs_per_thousand(after), gcs_per_thousand(after) - gcs_per_thousand(before),
+              after['peak_rss_kb'], change(before['peak_rss_kb'].to_f, after['peak_rss_kb'].to_f))
+end
+
+baseline, current = ARGV.map { |path| JSON.parse(File.read(path)) }
+
+abort "usage: #{$PROGRAM_NAME} BASELINE CURRENT" unless baseline && current
+
+%w[ruby yjit settings].each do |key|
+  warn "#{key} differs from the baseline: #{baseline[key]} vs #{current[key]}" if baseline[key] != current[key]
+end
+
+puts "baseline #{baseline['revision']} (#{baseline['time']}), current #{current['revision']} (#{current['time']})"
+
+regressed = current['results'].filter_map do |label, after|
+  before = baseline['results'][label]
+  next puts("#{label}: not in the baseline") unless before
+
+  report(label, before, after)
+
+  reasons = regressions(before, after)
+  "#{label}: #{reasons.join(', ')}" if reasons.any?
+end
+
+abort "Regressions:\n  #{regressed.join("\n  ")}" if regressed.any?
@@ -0,0 +1,93 @@
+# frozen_string_literal: true
+
+# Writes the payloads `rake bench` runs against. They're checked in so that
+# every run (and every machine) measures the same bytes, run this again only
+# to change the corpus, and save a new baseline afterwards.
+#
+# The terms are shaped like what an Elixir or Erlang node sends, and
+# are encoded the same way `:erlang.term_to_binary/1` would encode them.
+
+require_relative '../../lib/retf'
+
+CORPUS_DIR = __dir__
+
+random = Random.new(21)
+
+WORDS = %w[
+  the a message user room lobby hello world ok error elixir ruby phoenix channel socket join leave typing
+].freeze
+
+def sentence(random, words)
+  Array.new(words) { WORDS.sample(random: random) }.join(' ')
+end
+
+def timestamp(random)
+  Time.at(1_700_000_000 + random.rand(10_000_000)).utc.strftime('%Y-%m-%dT%H:%M:%SZ')
+end
+
+# A Phoenix channel push as sent by its ETF serializer: [join_ref, ref, topic, event, payload]
+def channel_message(random, ref)
+  [
+    '3', ref.to_s, "room:#{random.rand(100)}", 'new_msg',
+    {
+      'body' => sentence(random, random.rand(3..20)),
+      'user' => { 'id' => random.rand(1_000_000), 'name' => "user #{random.rand(1000)}", 'avatar' => nil },
+      'sent_at' => timestamp(random),
+      'mentions' => Array.new(random.rand(3)) { random.rand(1_000_000) }
+    }
+  ]
+end
+
+# An Ecto schema struct with a nested DateTime, most keys are atoms
+def user_struct(random, id)
+  {
+    __struct__: :'Elixir.Bench.Accounts.User',
+    __meta__: { __struct__: :'Elixir.Ecto.Schema.Metadata', state: :loaded, source: 'users', prefix: nil },
+    id: id,
+    email: "user#{id}@example.com",
+    name: sentence(random, 2),
+    roles: %i[admin editor viewer].sample(random.rand(1..3), random: random),
+    active: random.rand(4) != 0,
+    score: random.rand * 100,
+    inserted_at: {
+      __struct__: :'Elixir.DateTime', year: 2024, month: random.rand(1..12), day: random.rand(1..28),
+      hour: random.rand(24), minute: random.rand(60), second: random.rand(60),
+      microsecond: Retf::Tuple.new(random.rand(1_000_000), 6), time_zone: 'Etc/UTC', zone_abbr: 'UTC',
+      utc_offset: 0, std_offset: 0, calendar: :'Elixir.Calendar.ISO'
+    }
+  }
+end
+
+# A telemetry event: {:telemetry, [:name, :parts], measurements, timestamp}
+def telemetry_event(random)
+  Retf::Tuple.new(
+    :telemetry, %i[phoenix endpoint stop],
+    { duration: random.rand(1_000_000_000), memory: random.rand(1 << 30), load: random.rand },
+    1_700_000_000_000_000 + random.rand(1 << 40)
+  )
+end
+
+# About 1 MB of log lines, as a file upload or a log shipper would send them
+def log_chunk(random)
+  lines = Array.new(15_000) { "#{timestamp(random)} [info] #{sentence(random, 8)} #{random.rand(1 << 30)}" }
+
+  lines.join("\n").byteslice(0, 1024 * 1024)
+end
+
+CORPUS = {
+  'channel_message' => [channel_message(random, 1)],
+  'channel_history' => [Array.new(200) { |ref| channel_message(random, ref) }],
+  'structs' => [Array.new(500) { |id| user_struct(random, id) }],
+  'structs_compressed' => [Array.new(500) { |id| user_struct(random, id) }, { compress: true }],
+  'telemetry' => [Array.new(1000) { telemetry_event(random) }],
+  'bignums' => [Array.new(1000) { (random.rand(2) * 2 - 1) * random.rand(2**64..2**512) }],
+  'large_binary' => [Retf::Tuple.new(:upload, 'app.log', log_chunk(random))],
+  'large_binary_compressed' => [Retf::Tuple.new(:upload, 'app.log', log_chunk(random)), { compress: true }]
+}.freeze
+
+CORPUS.each do |name, (term, options)|
+  path = File.join(CORPUS_DIR, "#{name}.etf")
+
+  File.binwrite(path, Retf.encode(term, **options.to_h))
+  puts format('%-28s %8d bytes', File.basename(path), File.size(path))
+end
@@ -0,0 +1,58 @@
+# frozen_string_literal: true
+
+# Compares writing a large export message to a file through
+# `Retf.encode` against streaming it with `Retf.encode_to`,
+# both in time and in the memory allocated along the way.
+
+require 'benchmark/ips'
+require 'objspace'
+require 'tempfile'
+require_relative '../lib/retf'
+
+MESSAGE = {
+  rows: Array.new(50_000) { |i| { id: i, name: "user #{i}", score: i * 1.5 } },
+  attachments: Array.new(20) { 'x' * 1_000_000 }
+}.freeze
+
+# Bytes of Strings allocated while running the block
+def allocated_string_bytes
+  GC.start
+  GC.disable
+  before = ObjectSpace.memsize_of_all(String)
+  yield
+  ObjectSpace.memsize_of_all(String) - before
+ensure
+  GC.enable
+end
+
+file = Tempfile.new('retf', binmode: true)
+
+RubyVM::YJIT.enable
+
+Benchmark.ips do |x|
+  x.config(warmup: 1, time: 5)
+
+  x.report('encode then write') do
+    file.rewind
+    file.write(Retf.encode(MESSAGE))
+  end
+
+  x.report('encode_to') do
+    file.rewind
+    Retf.encode_to(file, MESSAGE)
+  end
+
+  x.compare!
+end
+
+write_all = allocated_string_bytes do
+  file.rewind
+  file.write(Retf.encode(MESSAGE))
+end
+
+stream = allocated_string_bytes do
+  file.rewind
+  Retf.encode_to(file, MESSAGE)
+end
+
+puts "encode then write allocated #{write_all} bytes of strings, encode_to #{stream}"
@@ -0,0 +1,83 @@
+# frozen_string_literal: true
+
+# Measures raw encoder throughput for the kinds of payloads
+# in `encoding_etf_only.rb` along with a few larger ones
+# that force the output buffer to grow several times.
+#
+# Alongside iterations per second this reports the encoded
+# bytes per second and the number of Ruby objects
+# allocated per encode, which should stay at one (the
+# output string) for terms that don't need `as_etf`.
+
+require 'benchmark/ips'
+require_relative '../lib/retf'
+require_relative '../spec/support/test_classes'
+
+SMALL_HASH = { a: 1, b: 2, c: 3, d: 4, e: 5, f: 6 }.freeze
+
+LONG_ARRAY = (1..100).to_a.freeze
+
+LONG_STRING = ('abc' * 100).freeze
+
+LARGE_HASH = {
+  foo: LONG_ARRAY,
+  bar: LONG_STRING,
+  baz: { a: { b: 2 }.freeze }.freeze,
+  qux: { a: [1, 2].freeze }.freeze,
+  quux: SMALL_HASH
+}.freeze
+
+MANY_SMALL_MAPS = Array.new(1_000) { |i| { id: i, name: "user #{i}", score: i * 1.5 }.freeze }.freeze
+
+MANY_STRUCTS = Array.new(1_000) { |i| Test::MyClass.new(i, "value #{i}").freeze }.freeze
+
+PAYLOADS = {
+  'small hash' => SMALL_HASH,
+  'long array' => LONG_ARRAY,
+  'long string' => LONG_STRING,
+  'large hash' => LARGE_HASH,
+  '1000 small maps' => MANY_SMALL_MAPS,
+  '1000 structs' => MANY_STRUCTS
+}.freeze
+
+def allocations_per_encode(value, iterations = 1_000)
+  GC.disable
+  before = GC.stat(:total_allocated_objects)
+  iterations.times { Retf.encode(value) }
+  (GC.stat(:total_allocated_objects) - before) / iterations.to_f
+ensure
+  GC.enable
+end
+
+def bytes_per_second(value, seconds = 1)
+  size = Retf.encode(value).bytesize
+  count = 0
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  deadline = start + seconds
+
+  while Process.clock_gettime(Process::CLOCK_MONOTONIC) < deadline
+    Retf.encode(value)
+    count += 1
+  end
+
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+  size * count / elapsed
+end
+
+RubyVM::YJIT.enable
+
+PAYLOADS.each do |name, value|
+  puts format('%-20<name>s %10<mbps>.2f MB/s %8<allocs>.2f objects/encode',
+              name:, mbps: bytes_per_second(value) / 1_000_000.0,
+              allocs: allocations_per_encode(value))
+end
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  PAYLOADS.each do |name, value|
+    x.report("ETF - encode #{name}") do
+      Retf.encode(value)
+    end
+  end
+end
@@ -35,6 +35,12 @@ HASH_WITH_ENCODABLE_CLASS = {
   c: HASH_WITH_ARRAY
 }.freeze
 
+ROWS = Array.new(1000) do |i|
+  { id: i, name: "user #{i}", email: "user#{i}@example.com", active: i.even?, team_id: i % 7 }.freeze
+end.freeze
+
+PREENCODED_LARGE_HASH = Retf.preencode(LARGE_HASH)
+
 RubyVM::YJIT.enable
 
 Benchmark.ips do |x|
@@ -66,6 +72,10 @@ Benchmark.ips do |x|
     Retf.encode(LARGE_HASH)
   end
 
+  x.report('ETF - encode pre-encoded large hash') do
+    Retf.encode([:message, PREENCODED_LARGE_HASH])
+  end
+
   x.report('ETF - encode large hash with compression') do
     Retf.encode(LARGE_HASH, compress: true)
   end
@@ -73,4 +83,8 @@ Benchmark.ips do |x|
   x.report('ETF - encode hash with encodable class') do
     Retf.encode(HASH_WITH_ENCODABLE_CLASS)
   end
+
+  x.report('ETF - encode rows of same-keyed hashes') do
+    Retf.encode(ROWS)
+  end
 end
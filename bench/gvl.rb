@@ -0,0 +1,70 @@
+# frozen_string_literal: true
+
+# How long small requests on other threads take while a large compressed
+# message is being decoded, as a web server handling both would see it.
+# Inflating and copying large binaries doesn't hold the GVL, so their
+# latency should stay about the same as when nothing else is running.
+
+require_relative '../lib/retf'
+
+WORDS = %w[GET POST /api/v1/users /health 200 404 500 ms user_id= session= ok error].freeze
+
+# About 50 MB of log lines, in binaries of 1 MB each
+def log_chunk(random)
+  Array.new(20_000) { Array.new(8) { WORDS.sample(random: random) }.join(' ') << random.rand(1 << 30).to_s }
+       .join("\n").byteslice(0, 1024 * 1024)
+end
+
+random = Random.new(1)
+PAYLOAD = Retf.encode(Array.new(50) { log_chunk(random) }, compress: true).freeze
+
+REQUEST = Retf.encode({ id: 1, user: 'ann', roles: %i[admin dev] }).freeze
+
+THREADS = 4
+DURATION = 3
+INTERVAL = 0.002
+
+# Each thread handles a small message every INTERVAL seconds. A request
+# counts as taking from when it was due until it was handled, so time
+# spent waiting for the GVL is included.
+def measure_requests
+  Array.new(THREADS) do
+    Thread.new do
+      latencies = []
+      due = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      deadline = due + DURATION
+
+      while due < deadline
+        delay = due - Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        sleep delay if delay.positive?
+
+        Retf.decode(REQUEST)
+        finished = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+        latencies << finished - due
+        due = [due + INTERVAL, finished].max
+      end
+
+      latencies
+    end
+  end.flat_map(&:value).sort
+end
+
+def report(label, latencies)
+  percentile = ->(p) { format('%8.3fms', latencies[(latencies.size - 1) * p / 100] * 1000) }
+
+  puts format('%-24s requests: %5d  p50: %s  p99: %s  max: %s',
+              label, latencies.size, percentile[50], percentile[99], percentile[100])
+end
+
+puts "payload: #{PAYLOAD.bytesize} bytes compressed"
+
+report('idle', measure_requests)
+
+decoding = true
+decoder = Thread.new { Retf.decode(PAYLOAD) while decoding }
+
+report('while decoding payload', measure_requests)
+
+decoding = false
+decoder.join
@@ -0,0 +1,56 @@
+# frozen_string_literal: true
+
+# Compares decoding and encoding a batch of `{packet, 4}` frames
+# one at a time from Ruby against doing the whole batch in a single
+# call with `Retf.decode_many` and `Retf.encode_many`.
+
+require 'benchmark/ips'
+require_relative '../lib/retf'
+
+MESSAGE = { event: :phx_reply, topic: 'room:lobby', ref: '12', payload: { status: :ok, response: {} } }.freeze
+
+BATCHES = [50, 500].to_h do |count|
+  values = Array.new(count) { |i| MESSAGE.merge(ref: i.to_s).freeze }.freeze
+  [count, values]
+end.freeze
+
+def decode_each(buffer)
+  terms = []
+  offset = 0
+
+  while offset < buffer.bytesize
+    size = buffer.unpack1('N', offset:)
+    terms << Retf.decode(buffer.byteslice(offset + 4, size))
+    offset += 4 + size
+  end
+
+  terms
+end
+
+def encode_each(values)
+  buffer = String.new(capacity: 1024, encoding: Encoding::BINARY)
+
+  values.each do |value|
+    encoded = Retf.encode(value)
+    buffer << [encoded.bytesize].pack('N') << encoded
+  end
+
+  buffer
+end
+
+RubyVM::YJIT.enable
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  BATCHES.each do |count, values|
+    buffer = Retf.encode_many(values).freeze
+
+    x.report("decode #{count} frames - per frame") { decode_each(buffer) }
+    x.report("decode #{count} frames - decode_many") { Retf.decode_many(buffer) }
+    x.report("encode #{count} frames - per frame") { encode_each(values) }
+    x.report("encode #{count} frames - encode_many") { Retf.encode_many(values) }
+  end
+
+  x.compare!
+end
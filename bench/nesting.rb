@@ -0,0 +1,29 @@
+# frozen_string_literal: true
+
+# Encoding and decoding nested documents, along with a list
+# nested far deeper than anything realistic.
+
+require 'benchmark/ips'
+require_relative '../lib/retf'
+
+DOCUMENT = {
+  user: { id: 1, name: 'ann', roles: %i[admin dev], address: { city: 'x', zip: 123 } },
+  items: Array.new(20) { |i| { sku: "s#{i}", qty: i, price: i * 1.5, tags: %i[a b] } },
+  meta: Retf::Tuple.new(:ok, [1, 2, 3])
+}.freeze
+
+DEEP = 10_000.times.reduce([]) { |inner, _| [inner] }
+
+ENCODED_DOCUMENT = Retf.encode(DOCUMENT).freeze
+ENCODED_DEEP = Retf.encode(DEEP).freeze
+
+RubyVM::YJIT.enable
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  x.report('encode document') { Retf.encode(DOCUMENT) }
+  x.report('decode document') { Retf.decode(ENCODED_DOCUMENT) }
+  x.report('encode 10k deep') { Retf.encode(DEEP) }
+  x.report('decode 10k deep') { Retf.decode(ENCODED_DEEP) }
+end
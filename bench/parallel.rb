@@ -0,0 +1,31 @@
+# frozen_string_literal: true
+
+# Compares decoding and encoding a large batch of messages one at a
+# time against spreading it across a Ractor per processor with
+# `Retf.decode_parallel` and `Retf.encode_parallel`.
+
+require 'benchmark/ips'
+require 'etc'
+require_relative '../lib/retf'
+
+MESSAGES = Ractor.make_shareable(
+  Array.new(20_000) do |i|
+    { id: i, event: :page_view, path: "/articles/#{i}", user: { id: i % 100, roles: %i[reader] }, at: i * 1.5 }
+  end
+)
+
+BINARIES = Ractor.make_shareable(MESSAGES.map { |message| Retf.encode(message) })
+
+puts "#{Etc.nprocessors} processors"
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  x.report('decode 20k - map') { BINARIES.map { |binary| Retf.decode(binary) } }
+  x.report('decode 20k - map, frozen') { BINARIES.map { |binary| Retf.decode(binary, freeze: true) } }
+  x.report('decode 20k - decode_parallel') { Retf.decode_parallel(BINARIES) }
+  x.report('encode 20k - map') { MESSAGES.map { |message| Retf.encode(message) } }
+  x.report('encode 20k - encode_parallel') { Retf.encode_parallel(MESSAGES) }
+
+  x.compare!
+end
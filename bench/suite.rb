@@ -0,0 +1,146 @@
+# frozen_string_literal: true
+
+# Encodes and decodes every payload in bench/corpus and writes what
+# it measured to the JSON file given as the first argument, which
+# bench/compare.rb can hold up against a baseline. Run through
+# `rake bench`, see the README for the knobs it takes.
+
+require 'json'
+require 'time'
+require_relative '../lib/retf'
+
+CORPUS = File.join(__dir__, 'corpus')
+
+BENCH_TIME = Float(ENV.fetch('BENCH_TIME', 3))
+BENCH_WARMUP = Float(ENV.fetch('BENCH_WARMUP', 1))
+BENCH_SAMPLES = Integer(ENV.fetch('BENCH_SAMPLES', 5))
+BENCH_FILTER = Regexp.new(ENV.fetch('BENCH_FILTER', ''))
+
+def clock
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+# Peak RSS in KB since the last reset_peak_rss, where Linux reports it
+def peak_rss
+  File.foreach('/proc/self/status') { |line| return Integer(line[/\d+/]) if line.start_with?('VmHWM:') }
+rescue SystemCallError
+  nil
+end
+
+def reset_peak_rss
+  File.write('/proc/self/clear_refs', '5')
+rescue SystemCallError
+  nil
+end
+
+# How many calls take about 10ms, so the clock is only read between batches
+def batch_size(&block)
+  batch = 1
+  batch *= 2 while time_batch(batch, &block) < 0.01
+
+  batch
+end
+
+def time_batch(batch, &block)
+  start = clock
+  batch.times(&block)
+
+  clock - start
+end
+
+# Runs `BENCH_SAMPLES` samples of `BENCH_TIME / BENCH_SAMPLES` seconds
+# each and returns the calls per second of each of them, along with how
+# many objects and collections all of those calls took.
+def run_samples(batch, &block)
+  gc = GC.stat
+  calls = 0
+
+  rates = Array.new(BENCH_SAMPLES) do
+    sample_calls = 0
+    elapsed = 0.0
+
+    while elapsed < BENCH_TIME / BENCH_SAMPLES
+      elapsed += time_batch(batch, &block)
+      sample_calls += batch
+    end
+
+    calls += sample_calls
+    sample_calls / elapsed
+  end
+
+  [rates.sort, calls, GC.stat.to_h { |key, value| [key, value - gc[key]] }]
+end
+
+def measure(bytes, &block)
+  GC.start
+  reset_peak_rss
+
+  batch = batch_size(&block)
+  warmup_end = clock + BENCH_WARMUP
+  time_batch(batch, &block) while clock < warmup_end
+
+  rates, calls, gc = run_samples(batch, &block)
+  median = rates[rates.size / 2]
+
+  {
+    ips: median.round(2),
+    ips_min: rates.first.round(2),
+    ips_max: rates.last.round(2),
+    bytes_per_second: (median * bytes).round,
+    objects_per_call: (gc[:total_allocated_objects].to_f / calls).round(2),
+    minor_gc_count: gc[:minor_gc_count],
+    major_gc_count: gc[:major_gc_count],
+    gc_time_ms: gc[:time],
+    calls: calls,
+    peak_rss_kb: peak_rss
+  }
+end
+
+def git_revision
+  `git -C #{__dir__} rev-parse --short HEAD 2>/dev/null`.strip
+rescue SystemCallError
+  ''
+end
+
+RubyVM::YJIT.enable if defined?(RubyVM::YJIT.enable) && ENV['BENCH_YJIT'] != '0'
+
+# What's measured for each payload, given it and the term it decodes to
+CODEC_PATHS = {
+  'decode' => ->(binary, _term) { proc { Retf.decode(binary) } },
+  'encode' => lambda do |binary, term|
+    compress = binary.getbyte(1) == 80
+    proc { Retf.encode(term, compress: compress) }
+  end
+}.freeze
+
+def report(label, result)
+  puts format('%-36s %12.1f i/s %10.1f MB/s %10.1f objects/call %8.2f GCs/1k %8s KB peak RSS',
+              label, result[:ips], result[:bytes_per_second] / 1e6, result[:objects_per_call],
+              (result[:minor_gc_count] + result[:major_gc_count]) * 1000.0 / result[:calls], result[:peak_rss_kb])
+end
+
+results = {}
+
+Dir[File.join(CORPUS, '*.etf')].sort.each do |file|
+  binary = File.binread(file).freeze
+  term = Retf.decode(binary)
+
+  CODEC_PATHS.each do |codec_path, call|
+    label = "#{codec_path} #{File.basename(file, '.etf')}"
+    next unless label.match?(BENCH_FILTER)
+
+    results[label] = { bytes: binary.bytesize, **measure(binary.bytesize, &call.call(binary, term)) }
+    report(label, results[label])
+  end
+end
+
+summary = {
+  ruby: RUBY_DESCRIPTION,
+  yjit: defined?(RubyVM::YJIT) ? RubyVM::YJIT.enabled? : false,
+  revision: git_revision,
+  time: Time.now.utc.iso8601,
+  settings: { time: BENCH_TIME, warmup: BENCH_WARMUP, samples: BENCH_SAMPLES },
+  results: results
+}
+
+File.write(ARGV[0], JSON.pretty_generate(summary)) if ARGV[0]
@@ -0,0 +1,33 @@
+# frozen_string_literal: true
+
+# Routing on a couple of fields of a large message, decoding all of
+# it with `Retf.decode` against only looking at them with `Retf.view`.
+
+require 'benchmark/ips'
+require_relative '../lib/retf'
+
+MESSAGE = Retf.encode(
+  {
+    type: :publish,
+    tenant: 'acme',
+    payload: Array.new(500) { |i| { id: i, name: "item #{i}", tags: %i[a b c], price: i * 1.5 } }
+  }
+).freeze
+
+RubyVM::YJIT.enable
+
+Benchmark.ips do |x|
+  x.config(warmup: 2, time: 5)
+
+  x.report('decode then route') do
+    message = Retf.decode(MESSAGE)
+    [message[:type], message[:tenant]]
+  end
+
+  x.report('view then route') do
+    message = Retf.view(MESSAGE)
+    [message[:type], message[:tenant]]
+  end
+
+  x.compare!
+end
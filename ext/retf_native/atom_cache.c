@@ -0,0 +1,334 @@
+#include "atom_cache.h"
+
+#include "stats.h"
+
+#ifdef HAVE_RUBY_RACTOR_H
+#include <ruby/ractor.h>
+#endif
+
+typedef struct {
+  VALUE value;
+  uint32_t hash;
+  rb_atomic_t generation;
+  unsigned char used;
+  unsigned char depends_on_constants;
+  unsigned char len;
+  char key[RETF_ATOM_CACHE_MAX_KEY];
+} atom_cache_entry;
+
+typedef struct {
+  VALUE key;
+  unsigned char len;
+  char bytes[RETF_ENCODED_ATOM_MAX_BYTES];
+} encoded_atom_entry;
+
+typedef struct {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  size_t size;
+  size_t encode_hits;
+  size_t encode_misses;
+  size_t encode_evictions;
+  size_t encode_size;
+  atom_cache_entry entries[RETF_ATOM_CACHE_SLOTS];
+
+  // Keyed by the Symbol or Class itself, empty slots have a key of 0.
+  encoded_atom_entry encoded[RETF_ENCODED_ATOM_SLOTS];
+} atom_cache;
+
+// Bumped whenever constants change, entries which depend on
+// constants are only valid for the generation they were resolved in.
+// Shared between all Ractors, so it must only be updated atomically.
+static rb_atomic_t constant_generation;
+
+static void atom_cache_mark(void *ptr) {
+  atom_cache *cache = ptr;
+
+  for (size_t i = 0; i < RETF_ATOM_CACHE_SLOTS; i++) {
+    if (cache->entries[i].used) {
+      rb_gc_mark(cache->entries[i].value);
+    }
+  }
+
+  // Dynamic symbols and classes must stay alive (and in place)
+  // while cached, otherwise a new object could be allocated at
+  // the same address and pick up the wrong encoding.
+  for (size_t i = 0; i < RETF_ENCODED_ATOM_SLOTS; i++) {
+    if (cache->encoded[i].key != 0) {
+      rb_gc_mark(cache->encoded[i].key);
+    }
+  }
+}
+
+static void atom_cache_free(void *ptr) { xfree(ptr); }
+
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_PTR_NEWKEY
+// Each Ractor gets its own table so lookups never need a lock.
+static rb_ractor_local_key_t cache_key;
+
+static const struct rb_ractor_local_storage_type cache_type = {
+    atom_cache_mark,
+    atom_cache_free,
+};
+
+static atom_cache *get_cache(void) {
+  atom_cache *cache = rb_ractor_local_storage_ptr(cache_key);
+
+  if (RB_UNLIKELY(cache == NULL)) {
+    cache = ZALLOC(atom_cache);
+    rb_ractor_local_storage_ptr_set(cache_key, cache);
+  }
+
+  return cache;
+}
+#else
+// Without Ractor local storage (TruffleRuby) there is a single table,
+// kept alive and marked through a wrapper object.
+static atom_cache *global_cache;
+
+static const rb_data_type_t cache_type = {
+    "Retf::Native::AtomCache",
+    {atom_cache_mark, atom_cache_free, NULL},
+    0, 0, 0,
+};
+
+static atom_cache *get_cache(void) { return global_cache; }
+#endif
+
+static inline void count_lookup(int hit) {
+  retf_stats *stats = retf_stats_get();
+
+  if (stats == NULL) {
+    return;
+  }
+
+  if (hit) {
+    stats->atom_cache_hits++;
+  } else {
+    stats->atom_cache_misses++;
+  }
+}
+
+static inline void count_encode_lookup(int hit) {
+  retf_stats *stats = retf_stats_get();
+
+  if (stats == NULL) {
+    return;
+  }
+
+  if (hit) {
+    stats->encode_atom_cache_hits++;
+  } else {
+    stats->encode_atom_cache_misses++;
+  }
+}
+
+void retf_atom_cache_invalidate_constants(void) {
+  RUBY_ATOMIC_INC(constant_generation);
+}
+
+VALUE retf_atom_cache_fetch(const char *ptr, size_t len,
+                            int depends_on_constants,
+                            VALUE (*resolve)(const char *ptr, size_t len)) {
+  if (len > RETF_ATOM_CACHE_MAX_KEY) {
+    return resolve(ptr, len);
+  }
+
+  atom_cache *cache = get_cache();
+  uint32_t hash = retf_hash_bytes(ptr, len);
+  size_t home = hash & (RETF_ATOM_CACHE_SLOTS - 1);
+  rb_atomic_t generation = constant_generation;
+  atom_cache_entry *free_slot = NULL;
+  atom_cache_entry *stale = NULL;
+
+  for (size_t i = 0; i < RETF_ATOM_CACHE_MAX_PROBE; i++) {
+    atom_cache_entry *entry =
+        &cache->entries[(home + i) & (RETF_ATOM_CACHE_SLOTS - 1)];
+
+    // Entries are never removed one at a time,
+    // so an empty slot means the atom isn't cached.
+    if (!entry->used) {
+      free_slot = entry;
+      break;
+    }
+
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->key, ptr, len) == 0) {
+      if (!entry->depends_on_constants || entry->generation == generation) {
+        cache->hits++;
+        count_lookup(1);
+        return entry->value;
+      }
+
+      // Stale, re-resolve it into the same slot.
+      free_slot = stale = entry;
+      break;
+    }
+  }
+
+  cache->misses++;
+  count_lookup(0);
+
+  VALUE value = resolve(ptr, len);
+
+  // Strings stand in for atoms that aren't symbols yet,
+  // so look them up again in case they've become one.
+  if (RB_TYPE_P(value, T_STRING)) {
+    return value;
+  }
+
+  // The probe sequence was full, so evict whatever
+  // lives in the home slot rather than growing.
+  atom_cache_entry *entry =
+      free_slot != NULL ? free_slot : &cache->entries[home];
+
+  if (!entry->used) {
+    cache->size++;
+  } else if (entry != stale) {
+    cache->evictions++;
+  }
+
+  entry->value = value;
+  entry->hash = hash;
+  entry->generation = generation;
+  entry->depends_on_constants = depends_on_constants;
+  entry->len = len;
+  entry->used = 1;
+  memcpy(entry->key, ptr, len);
+
+  return value;
+}
+
+static inline size_t encoded_home_slot(VALUE key) {
+  // Heap objects are at least 8 byte aligned, and static
+  // symbols have their flag bits at the bottom, so drop
+  // those before mixing.
+  uint64_t hash = ((uint64_t)key >> 3) * 0x9E3779B97F4A7C15ull;
+  return (size_t)(hash >> 32) & (RETF_ENCODED_ATOM_SLOTS - 1);
+}
+
+const char *retf_atom_cache_encoded(VALUE key, size_t *len) {
+  atom_cache *cache = get_cache();
+  size_t home = encoded_home_slot(key);
+
+  for (size_t i = 0; i < RETF_ATOM_CACHE_MAX_PROBE; i++) {
+    encoded_atom_entry *entry =
+        &cache->encoded[(home + i) & (RETF_ENCODED_ATOM_SLOTS - 1)];
+
+    if (entry->key == key) {
+      cache->encode_hits++;
+      count_encode_lookup(1);
+      *len = entry->len;
+      return entry->bytes;
+    }
+
+    if (entry->key == 0) {
+      break;
+    }
+  }
+
+  cache->encode_misses++;
+  count_encode_lookup(0);
+
+  return NULL;
+}
+
+void retf_atom_cache_store_encoded(VALUE key, const char *bytes, size_t len) {
+  if (len > RETF_ENCODED_ATOM_MAX_BYTES) {
+    return;
+  }
+
+  atom_cache *cache = get_cache();
+  size_t home = encoded_home_slot(key);
+  encoded_atom_entry *entry = &cache->encoded[home];
+
+  for (size_t i = 0; i < RETF_ATOM_CACHE_MAX_PROBE; i++) {
+    encoded_atom_entry *candidate =
+        &cache->encoded[(home + i) & (RETF_ENCODED_ATOM_SLOTS - 1)];
+
+    if (candidate->key == 0 || candidate->key == key) {
+      entry = candidate;
+      break;
+    }
+  }
+
+  if (entry->key == 0) {
+    cache->encode_size++;
+  } else if (entry->key != key) {
+    cache->encode_evictions++;
+  }
+
+  entry->key = key;
+  entry->len = len;
+  memcpy(entry->bytes, bytes, len);
+}
+
+static VALUE retf_atom_cache_stats(VALUE self) {
+  atom_cache *cache = get_cache();
+
+  VALUE stats = rb_hash_new_capa(10);
+  rb_hash_aset(stats, ID2SYM(rb_intern("hits")), SIZET2NUM(cache->hits));
+  rb_hash_aset(stats, ID2SYM(rb_intern("misses")), SIZET2NUM(cache->misses));
+  rb_hash_aset(stats, ID2SYM(rb_intern("evictions")),
+               SIZET2NUM(cache->evictions));
+  rb_hash_aset(stats, ID2SYM(rb_intern("size")), SIZET2NUM(cache->size));
+  rb_hash_aset(stats, ID2SYM(rb_intern("capacity")),
+               SIZET2NUM(RETF_ATOM_CACHE_SLOTS));
+  rb_hash_aset(stats, ID2SYM(rb_intern("encode_hits")),
+               SIZET2NUM(cache->encode_hits));
+  rb_hash_aset(stats, ID2SYM(rb_intern("encode_misses")),
+               SIZET2NUM(cache->encode_misses));
+  rb_hash_aset(stats, ID2SYM(rb_intern("encode_evictions")),
+               SIZET2NUM(cache->encode_evictions));
+  rb_hash_aset(stats, ID2SYM(rb_intern("encode_size")),
+               SIZET2NUM(cache->encode_size));
+  rb_hash_aset(stats, ID2SYM(rb_intern("encode_capacity")),
+               SIZET2NUM(RETF_ENCODED_ATOM_SLOTS));
+
+  return stats;
+}
+
+static VALUE retf_atom_cache_clear(VALUE self) {
+  atom_cache *cache = get_cache();
+
+  memset(cache, 0, sizeof(atom_cache));
+
+  return Qnil;
+}
+
+static VALUE retf_clear_constant_cache(VALUE self) {
+  retf_atom_cache_invalidate_constants();
+  return Qnil;
+}
+
+// Prepended to Module so that defining any constant
+// invalidates module names which may now resolve to it.
+// A `self.const_added` which doesn't call `super` skips it.
+static VALUE retf_const_added(VALUE self, VALUE name) {
+  retf_atom_cache_invalidate_constants();
+  return rb_call_super(1, &name);
+}
+
+void retf_atom_cache_setup(VALUE mRetfNative) {
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_PTR_NEWKEY
+  cache_key = rb_ractor_local_storage_ptr_newkey(&cache_type);
+#else
+  global_cache = ZALLOC(atom_cache);
+  rb_gc_register_mark_object(
+      TypedData_Wrap_Struct(rb_cObject, &cache_type, global_cache));
+#endif
+
+  rb_define_module_function(mRetfNative, "atom_cache_stats",
+                            retf_atom_cache_stats, 0);
+  rb_define_module_function(mRetfNative, "clear_atom_cache",
+                            retf_atom_cache_clear, 0);
+  rb_define_module_function(mRetfNative, "clear_constant_cache",
+                            retf_clear_constant_cache, 0);
+
+  VALUE mConstantTracking =
+      rb_define_module_under(mRetfNative, "ConstantTracking");
+  rb_define_private_method(mConstantTracking, "const_added", retf_const_added,
+                           1);
+  rb_prepend_module(rb_cModule, mConstantTracking);
+}
@@ -0,0 +1,67 @@
+#ifndef RETF_ATOM_CACHE_H
+#define RETF_ATOM_CACHE_H
+
+#include <ruby.h>
+#include <ruby/atomic.h>
+#include <stdint.h>
+#include <string.h>
+
+// Atoms longer than this (in bytes) are never cached,
+// they're rare and would bloat every entry in the table.
+#define RETF_ATOM_CACHE_MAX_KEY 64
+
+// Must be a power of 2.
+#define RETF_ATOM_CACHE_SLOTS 2048
+
+// How many slots to look at before giving up
+// and replacing whatever is in the home slot.
+#define RETF_ATOM_CACHE_MAX_PROBE 8
+
+// Room for the tag, length and atom bytes of a cached encoded atom,
+// chosen so that each encoded entry fits in 96 bytes.
+#define RETF_ENCODED_ATOM_MAX_BYTES 87
+
+// Must be a power of 2.
+#define RETF_ENCODED_ATOM_SLOTS 1024
+
+// FNV-1a, atoms are short so there's
+// no need for anything fancier.
+static inline uint32_t retf_hash_bytes(const char *ptr, size_t len) {
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)ptr[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+void retf_atom_cache_setup(VALUE mRetfNative);
+
+// Looks up the already resolved Ruby value for the raw atom bytes,
+// on a miss `resolve` is called to produce it and the result is cached,
+// unless it's a String.
+//
+// The table has a fixed number of slots so hostile inputs with many
+// distinct atoms can only evict entries, never grow it.
+//
+// If `depends_on_constants` is set (e.g. for Elixir module names)
+// the cached value is thrown away whenever a constant is defined
+// or `retf_atom_cache_invalidate_constants` is called.
+VALUE retf_atom_cache_fetch(const char *ptr, size_t len,
+                            int depends_on_constants,
+                            VALUE (*resolve)(const char *ptr, size_t len));
+
+void retf_atom_cache_invalidate_constants(void);
+
+// Looks up the complete ETF encoding (tag, length prefix and bytes)
+// previously stored for a Symbol or Class, returning NULL if
+// there isn't one.
+const char *retf_atom_cache_encoded(VALUE key, size_t *len);
+
+// Remembers the ETF encoding of a Symbol or Class,
+// encodings which are too long to fit are ignored.
+void retf_atom_cache_store_encoded(VALUE key, const char *bytes, size_t len);
+
+#endif  // RETF_ATOM_CACHE_H
@@ -5,8 +5,6 @@ static VALUE PID_CLASS;
 static VALUE REFERENCE_CLASS;
 static VALUE TUPLE_CLASS;
 static VALUE BITSTRING_CLASS;
-static VALUE ZLIB_INFLATE;
-static VALUE ZLIB_DEFLATE;
 
 // Symbols
 static VALUE STRUCT;
@@ -22,21 +20,42 @@ the object to ETF.
 static VALUE AS_ETF;
 static VALUE TO_ETF;
 
+// Instance variables, set directly when
+// building objects while decoding.
+static VALUE VALUE_IVAR;
+static VALUE SIZE_IVAR;
+static VALUE NODE_IVAR;
+static VALUE ID_IVAR;
+static VALUE SERIAL_IVAR;
+static VALUE CREATION_IVAR;
+static VALUE BINARY_IVAR;
+static VALUE BITS_SIZE_IVAR;
+
 void retf_constants_setup(VALUE mRetf) {
   PID_CLASS = rb_const_get(mRetf, rb_intern("PID"));
   REFERENCE_CLASS = rb_const_get(mRetf, rb_intern("Reference"));
   TUPLE_CLASS = rb_const_get(mRetf, rb_intern("Tuple"));
   BITSTRING_CLASS = rb_const_get(mRetf, rb_intern("BitBinary"));
 
-  VALUE zlib = rb_const_get(rb_cObject, rb_intern("Zlib"));
-
-  ZLIB_INFLATE = rb_const_get(zlib, rb_intern("Inflate"));
-  ZLIB_DEFLATE = rb_const_get(zlib, rb_intern("Deflate"));
+  // Pinned so compaction can't move them out from under us
+  rb_gc_register_mark_object(PID_CLASS);
+  rb_gc_register_mark_object(REFERENCE_CLASS);
+  rb_gc_register_mark_object(TUPLE_CLASS);
+  rb_gc_register_mark_object(BITSTRING_CLASS);
 
   STRUCT = rb_intern("__struct__");
 
   AS_ETF = rb_intern("as_etf");
   TO_ETF = rb_intern("to_etf");
+
+  VALUE_IVAR = rb_intern("@value");
+  SIZE_IVAR = rb_intern("@size");
+  NODE_IVAR = rb_intern("@node");
+  ID_IVAR = rb_intern("@id");
+  SERIAL_IVAR = rb_intern("@serial");
+  CREATION_IVAR = rb_intern("@creation");
+  BINARY_IVAR = rb_intern("@binary");
+  BITS_SIZE_IVAR = rb_intern("@bits_size");
 }
 
 VALUE retf_constants_get_pid_class(void) { return PID_CLASS; }
@@ -47,12 +66,24 @@ VALUE retf_constants_get_tuple_class(void) { return TUPLE_CLASS; }
 
 VALUE retf_constants_get_bitstring_class(void) { return BITSTRING_CLASS; }
 
-VALUE retf_constants_get_zlib_inflate(void) { return ZLIB_INFLATE; }
-
-VALUE retf_constants_get_zlib_deflate(void) { return ZLIB_DEFLATE; }
-
 VALUE retf_constants_get_struct(void) { return STRUCT; }
 
 VALUE retf_constants_get_as_etf(void) { return AS_ETF; }
 
 VALUE retf_constants_get_to_etf(void) { return TO_ETF; }
+
+VALUE retf_constants_get_value_ivar(void) { return VALUE_IVAR; }
+
+VALUE retf_constants_get_size_ivar(void) { return SIZE_IVAR; }
+
+VALUE retf_constants_get_node_ivar(void) { return NODE_IVAR; }
+
+VALUE retf_constants_get_id_ivar(void) { return ID_IVAR; }
+
+VALUE retf_constants_get_serial_ivar(void) { return SERIAL_IVAR; }
+
+VALUE retf_constants_get_creation_ivar(void) { return CREATION_IVAR; }
+
+VALUE retf_constants_get_binary_ivar(void) { return BINARY_IVAR; }
+
+VALUE retf_constants_get_bits_size_ivar(void) { return BITS_SIZE_IVAR; }
@@ -28,24 +28,6 @@
 #define RETF_MOD_NAME(m) rb_funcall(m, rb_intern("name"), 0)
 #endif
 
-#ifdef HAVE_RB_BIG_EQ
-#define RETF_BIG_EQ(a, b) rb_big_eq(a, b)
-#else
-#define RETF_BIG_EQ(a, b) rb_funcall(a, rb_intern("=="), 1, b)
-#endif
-
-#ifdef HAVE_RB_BIG_AND
-#define RETF_BIG_AND(a, b) rb_big_and(a, b)
-#else
-#define RETF_BIG_AND(a, b) rb_funcall(a, rb_intern("&"), 1, b)
-#endif
-
-#ifdef HAVE_RB_BIG_RSHIFT
-#define RETF_BIG_RSHIFT(a, b) rb_big_rshift(a, b)
-#else
-#define RETF_BIG_RSHIFT(a, b) rb_funcall(a, rb_intern(">>"), 1, b)
-#endif
-
 void retf_constants_setup(VALUE mRetf);
 
 // Classes
@@ -53,12 +35,20 @@ VALUE retf_constants_get_pid_class(void);
 VALUE retf_constants_get_reference_class(void);
 VALUE retf_constants_get_tuple_class(void);
 VALUE retf_constants_get_bitstring_class(void);
-VALUE retf_constants_get_zlib_inflate(void);
-VALUE retf_constants_get_zlib_deflate(void);
 
 // Symbols
 VALUE retf_constants_get_struct(void);
 VALUE retf_constants_get_as_etf(void);
 VALUE retf_constants_get_to_etf(void);
 
+// Instance variables
+VALUE retf_constants_get_value_ivar(void);
+VALUE retf_constants_get_size_ivar(void);
+VALUE retf_constants_get_node_ivar(void);
+VALUE retf_constants_get_id_ivar(void);
+VALUE retf_constants_get_serial_ivar(void);
+VALUE retf_constants_get_creation_ivar(void);
+VALUE retf_constants_get_binary_ivar(void);
+VALUE retf_constants_get_bits_size_ivar(void);
+
 #endif  // RETF_CONSTANTS_H
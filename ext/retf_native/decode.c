@@ -1,29 +1,22 @@
 #include "decode.h"
 
+#include "tags.h"
+
 static unsigned char decode_byte(decoder_state* state);
 static void do_version_check(decoder_state* state);
-static VALUE decode_small_atom(decoder_state* state);
-static VALUE decode_atom(decoder_state* state);
-static uint16_t decode_short(decoder_state* state);
+static VALUE decode_atom(decoder_state* state, unsigned char tag);
 static uint32_t decode_int(decoder_state* state);
 static int32_t decode_signed_int(decoder_state* state);
 static VALUE decode_float(decoder_state* state);
 static VALUE decode_any_atom(decoder_state* state);
 static VALUE decode_binary(decoder_state* state);
-static VALUE decode_small_tuple(decoder_state* state);
-static VALUE decode_large_tuple(decoder_state* state);
-static VALUE decode_list(decoder_state* state);
 static VALUE decode_erl_string(decoder_state* state);
-static VALUE decode_reference(decoder_state* state);
-static VALUE decode_pid(decoder_state* state);
+static VALUE decode_reference(decoder_state* state, int wide_creation);
+static VALUE decode_pid(decoder_state* state, int wide_creation);
 static VALUE decode_bit_binary(decoder_state* state);
 
-static VALUE symbolize_string(VALUE str);
-
-static VALUE decode_term(decoder_state* state);
 
-// callback for rb_ensure to free an allocated temporary buffer
-static VALUE free_unpack_data(VALUE data);
+static VALUE decode_term(decoder_state* state, int compressed);
 
 #ifndef HAVE_RB_HASH_BULK_INSERT
 // For TruffleRuby
@@ -38,20 +31,160 @@ void rb_hash_bulk_insert(long count, const VALUE *pairs, VALUE hash) {
 }
 #endif
 
-VALUE retf_decode(VALUE self, VALUE str, VALUE skip_version_check) {
+static void parse_share_binaries(VALUE share_binaries, decoder_options* options) {
+  if (!RTEST(share_binaries)) {
+    options->share_threshold = 0;
+  } else if (share_binaries == Qtrue) {
+    options->share_threshold = RETF_DEFAULT_SHARE_THRESHOLD;
+  } else {
+    // Sharing a zero length binary makes no sense,
+    // treat it the same as a threshold of 1.
+    size_t threshold = NUM2SIZET(share_binaries);
+    options->share_threshold = threshold == 0 ? 1 : threshold;
+  }
+}
+
+size_t retf_parse_dedup_binaries(VALUE dedup_binaries) {
+  if (!RTEST(dedup_binaries)) {
+    return 0;
+  } else if (dedup_binaries == Qtrue) {
+    return RETF_DEFAULT_DEDUP_THRESHOLD;
+  }
+
+  return NUM2SIZET(dedup_binaries);
+}
+
+void retf_parse_limits(decoder_options* options, VALUE max_depth,
+                       VALUE max_bytes, VALUE max_terms,
+                       VALUE max_decompressed_bytes) {
+  options->max_depth = retf_parse_limit(max_depth, "max_depth");
+  options->max_bytes = retf_parse_limit(max_bytes, "max_bytes");
+  options->max_terms = retf_parse_limit(max_terms, "max_terms");
+  options->max_decompressed_bytes =
+      retf_parse_limit(max_decompressed_bytes, "max_decompressed_bytes");
+}
+
+int retf_parse_byte_lists(VALUE byte_lists) {
+  if (NIL_P(byte_lists) || byte_lists == ID2SYM(rb_intern("string"))) {
+    return 0;
+  } else if (byte_lists == ID2SYM(rb_intern("array"))) {
+    return 1;
+  }
+
+  rb_raise(rb_eArgError, "byte_lists must be :string or :array");
+}
+
+int retf_parse_atoms(VALUE atoms) {
+  if (NIL_P(atoms) || atoms == ID2SYM(rb_intern("symbol"))) {
+    return RETF_ATOMS_SYMBOL;
+  } else if (atoms == ID2SYM(rb_intern("existing"))) {
+    return RETF_ATOMS_EXISTING;
+  } else if (atoms == ID2SYM(rb_intern("string"))) {
+    return RETF_ATOMS_STRING;
+  }
+
+  rb_raise(rb_eArgError, "atoms must be :symbol, :existing or :string");
+}
+
+VALUE retf_decode(VALUE self, VALUE str, VALUE skip_version_check,
+                  VALUE share_binaries, VALUE max_depth, VALUE max_bytes,
+                  VALUE max_terms, VALUE max_decompressed_bytes,
+                  VALUE freeze, VALUE atoms, VALUE dedup_binaries,
+                  VALUE byte_lists) {
   Check_Type(str, T_STRING);
 
+  decoder_options options;
+  parse_share_binaries(share_binaries, &options);
+  options.dedup_threshold = retf_parse_dedup_binaries(dedup_binaries);
+
+  options.freeze = RTEST(freeze);
+  options.atoms = retf_parse_atoms(atoms);
+  options.byte_lists = retf_parse_byte_lists(byte_lists);
+
+  retf_parse_limits(&options, max_depth, max_bytes, max_terms,
+                    max_decompressed_bytes);
+
   char *buffer = RSTRING_PTR(str);
   size_t buffer_size = RSTRING_LEN(str);
   size_t offset = 0;
 
-  decoder_state state = {buffer, buffer_size, offset};
+  if (RB_UNLIKELY(options.max_bytes != 0 && buffer_size > options.max_bytes)) {
+    rb_raise(rb_eArgError, "input is larger than max_bytes");
+  }
+
+  decoder_state state = {buffer, buffer_size, offset, str, &options};
 
   if (!RTEST(skip_version_check)) {
     do_version_check(&state);
   }
 
-  return decode_term(&state);
+  return decode_term(&state, 1);
+}
+
+VALUE retf_decode_many(VALUE self, VALUE str, VALUE packet,
+                       VALUE share_binaries, VALUE atoms,
+                       VALUE dedup_binaries, VALUE byte_lists,
+                       VALUE max_depth, VALUE max_bytes, VALUE max_terms,
+                       VALUE max_decompressed_bytes) {
+  Check_Type(str, T_STRING);
+
+  int prefix = retf_parse_packet(packet);
+
+  decoder_options options = {0};
+  parse_share_binaries(share_binaries, &options);
+  options.dedup_threshold = retf_parse_dedup_binaries(dedup_binaries);
+  options.byte_lists = retf_parse_byte_lists(byte_lists);
+  options.atoms = retf_parse_atoms(atoms);
+  retf_parse_limits(&options, max_depth, max_bytes, max_terms,
+                    max_decompressed_bytes);
+
+  const char *buffer = RSTRING_PTR(str);
+  size_t buffer_size = RSTRING_LEN(str);
+  size_t offset = 0;
+
+  if (RB_UNLIKELY(options.max_bytes != 0 && buffer_size > options.max_bytes)) {
+    rb_raise(rb_eArgError, "input is larger than max_bytes");
+  }
+
+  VALUE terms = rb_ary_new();
+
+  while (offset < buffer_size) {
+    size_t size = buffer_size - offset;
+
+    if (prefix != 0) {
+      if (RB_UNLIKELY(size < (size_t)prefix)) {
+        rb_raise(rb_eArgError, "Unexpected end of input");
+      }
+
+      size = retf_packet_read(buffer + offset, prefix);
+      offset += prefix;
+
+      if (RB_UNLIKELY(size > buffer_size - offset)) {
+        rb_raise(rb_eArgError, "Unexpected end of input");
+      }
+    }
+
+    decoder_state state = {buffer + offset, size, 0, str, &options};
+
+    rb_ary_push(terms, retf_decode_state(&state, 1));
+
+    // Without a prefix terms are back to back,
+    // so the next one starts where this one ended.
+    offset += prefix != 0 ? size : state.offset;
+  }
+
+  RB_GC_GUARD(str);
+
+  return terms;
+}
+
+VALUE retf_decode_state(decoder_state* state, int check_version) {
+  if (check_version) {
+    do_version_check(state);
+  }
+
+  // A compressed term is only valid directly after the version byte.
+  return decode_term(state, check_version);
 }
 
 static void do_version_check(decoder_state* state) {
@@ -62,32 +195,36 @@ static void do_version_check(decoder_state* state) {
   }
 }
 
-static unsigned char decode_byte(decoder_state* state) {
-  if (RB_UNLIKELY(state->offset >= state->buffer_size)) {
+// Every term takes at least a byte, so a length claiming more
+// elements than there are bytes left can't be right. Checking
+// this first keeps hostile lengths from causing huge allocations.
+static void check_count(decoder_state* state, size_t count) {
+  if (RB_UNLIKELY(count > state->buffer_size - state->offset)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
   }
+}
 
-  unsigned char b = state->buffer[state->offset];
-  state->offset += 1;
+static void enter_container(decoder_state* state) {
+  size_t max_depth = state->options->max_depth;
 
-  return b;
+  if (RB_UNLIKELY(++state->depth > max_depth && max_depth != 0)) {
+    rb_raise(rb_eArgError, "term is nested deeper than max_depth");
+  }
 }
 
-static uint16_t decode_short(decoder_state* state) {
-  if (RB_UNLIKELY(state->offset + 2 > state->buffer_size)) {
+static inline void leave_container(decoder_state* state) {
+  state->depth--;
+}
+
+static unsigned char decode_byte(decoder_state* state) {
+  if (RB_UNLIKELY(state->offset >= state->buffer_size)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
   }
 
-  uint16_t num, short_value;
-
-  num = *(uint16_t *)(state->buffer + state->offset);
-
-  state->offset += 2;
-
-  // It is in network byte order
-  short_value = be16toh(num);
+  unsigned char b = state->buffer[state->offset];
+  state->offset += 1;
 
-  return short_value;
+  return b;
 }
 
 static uint32_t decode_int(decoder_state* state) {
@@ -107,6 +244,21 @@ static uint32_t decode_int(decoder_state* state) {
   return int_value;
 }
 
+// Reads the length or element count at the start of the
+// header of a term with `tag`, as laid out in tags.h.
+static inline uint64_t decode_count(decoder_state* state, unsigned char tag) {
+  retf_tag_layout layout = retf_tag_layout_of(tag);
+
+  if (RB_UNLIKELY(layout.width > state->buffer_size - state->offset)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+
+  uint64_t count = retf_tag_count(tag, layout, state->buffer + state->offset);
+  state->offset += layout.width;
+
+  return count;
+}
+
 static int32_t decode_signed_int(decoder_state* state) {
   if (RB_UNLIKELY(state->offset + 4 > state->buffer_size)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
@@ -144,409 +296,636 @@ static VALUE decode_float(decoder_state* state) {
   return DBL2NUM(value);
 }
 
-static VALUE decode_small_atom(decoder_state* state) {
-  unsigned char length = decode_byte(state);
-
-  if (RB_UNLIKELY(state->offset + length > state->buffer_size)) {
-    rb_raise(rb_eArgError, "Unexpected end of input");
-  }
-
-  const char *str_ptr = state->buffer + state->offset;
-  state->offset += length;
-
+// true, false and nil, or Qundef for any other atom
+static inline VALUE special_atom(const char *str_ptr, size_t length) {
   if (length == 4 && memcmp(str_ptr, "true", 4) == 0) {
     return Qtrue;
   } else if (length == 5 && memcmp(str_ptr, "false", 5) == 0) {
     return Qfalse;
-  } else if (length == 3 && memcmp(str_ptr, "nil", 4) == 0) {
+  } else if (length == 3 && memcmp(str_ptr, "nil", 3) == 0) {
     return Qnil;
   }
 
-  VALUE str = rb_utf8_str_new(str_ptr, length);
-
-  return symbolize_string(str);
+  return Qundef;
 }
 
-static VALUE decode_atom(decoder_state* state) {
-  uint_least16_t length = decode_short(state);
+static inline int is_module_name(const char *str_ptr, size_t length) {
+  return length > 7 && memcmp(str_ptr, "Elixir.", 7) == 0;
+}
 
-  if (RB_UNLIKELY(state->offset + length > state->buffer_size)) {
-    rb_raise(rb_eArgError, "Unexpected end of input");
+// The constant an Elixir module name refers to after "rubifying" it
+// (e.g. `:"Elixir.MyModule.MyClass"` -> `MyModule::MyClass`), or Qundef
+// if it isn't a module name or there is no such constant.
+//
+// Looking the name up doesn't intern it, so this is safe for atoms
+// which shouldn't become symbols either.
+static VALUE module_from_atom(const char *str_ptr, size_t length) {
+  if (!is_module_name(str_ptr, length)) {
+    return Qundef;
   }
 
-  const char *str_ptr = state->buffer + state->offset;
-  state->offset += length;
+  // Not spending too much time on making this efficient
+  // as its likely not the most common case.
+  VALUE prefix_deleted = rb_utf8_str_new(str_ptr + 7, length - 7);
 
-  if (length == 4 && memcmp(str_ptr, "true", 4) == 0) {
-    return Qtrue;
-  } else if (length == 5 && memcmp(str_ptr, "false", 5) == 0) {
-    return Qfalse;
-  } else if (length == 3 && memcmp(str_ptr, "nil", 4) == 0) {
-    return Qnil;
+  VALUE rubified = rb_funcall(prefix_deleted, rb_intern("gsub"), 2,
+                              rb_str_new_lit("."), rb_str_new_lit("::"));
+
+  VALUE defined =
+      rb_funcall(rb_cObject, rb_intern("const_defined?"), 1, rubified);
+
+  if (RTEST(defined)) {
+    return rb_funcall(rb_cObject, rb_intern("const_get"), 1, rubified);
   }
 
-  VALUE str = rb_utf8_str_new(str_ptr, length);
+  return Qundef;
+}
 
-  return symbolize_string(str);
+static inline VALUE atom_string(const char *str_ptr, size_t length) {
+  return rb_obj_freeze(rb_utf8_str_new(str_ptr, length));
 }
 
-static VALUE decode_any_atom(decoder_state* state) {
-  unsigned char tag = decode_byte(state);
+static VALUE resolve_atom(const char *str_ptr, size_t length) {
+  VALUE value = special_atom(str_ptr, length);
 
-  switch (tag) {
-    case 115:
-    case 119:
-      return decode_small_atom(state);
-    case 100:
-    case 118:
-      return decode_atom(state);
-    default:
-      rb_raise(rb_eArgError, "expected an atom tag, got %u", (unsigned int)tag);
+  if (value == Qundef) {
+    value = module_from_atom(str_ptr, length);
   }
-}
 
-static VALUE symbolize_string(VALUE str) {
-  Check_Type(str, T_STRING);
+  if (value == Qundef) {
+    value = rb_to_symbol(rb_utf8_str_new(str_ptr, length));
+  }
+
+  return value;
+}
 
-  char *c_str = RSTRING_PTR(str);
-  size_t c_str_len = RSTRING_LEN(str);
+// Like `resolve_atom`, but without interning new symbols. Those
+// atoms become frozen Strings instead, which the atom cache doesn't
+// keep so that they're looked up again should the symbol be created.
+static VALUE resolve_existing_atom(const char *str_ptr, size_t length) {
+  VALUE value = special_atom(str_ptr, length);
 
-  if (c_str_len <= 7 || memcmp(c_str, "Elixir.", 7) != 0) {
-    return rb_to_symbol(str);
+  if (value == Qundef) {
+    value = module_from_atom(str_ptr, length);
   }
 
-  // confirmed we have something that looks like it could
-  // be an Elixir module. Let's try to "rubify" it.
-  //
-  // Not spending too much time on making this efficient
-  // as its likely not the most common case.
+  if (value != Qundef) {
+    return value;
+  }
 
-  VALUE prefix_deleted = rb_utf8_str_new(c_str + 7, c_str_len - 7);
+  value = rb_check_symbol_cstr(str_ptr, length, rb_utf8_encoding());
 
-  VALUE rubified = rb_funcall(prefix_deleted, rb_intern("gsub"), 2,
-                              rb_str_new_lit("."), rb_str_new_lit("::"));
+  return NIL_P(value) ? atom_string(str_ptr, length) : value;
+}
 
-  VALUE defined =
-      rb_funcall(rb_cObject, rb_intern("const_defined?"), 1, rubified);
+VALUE retf_atom_from_bytes(const char *str_ptr, size_t length) {
+  // Whether an Elixir module name resolves to a constant can change,
+  // so those are re-resolved whenever a constant is defined.
+  return retf_atom_cache_fetch(str_ptr, length,
+                               is_module_name(str_ptr, length), resolve_atom);
+}
 
-  if (RTEST(defined)) {
-    return rb_funcall(rb_cObject, rb_intern("const_get"), 1, rubified);
-  } else {
-    return rb_to_symbol(str);
+static VALUE atom_from_input(decoder_state* state, const char *str_ptr,
+                             size_t length) {
+  switch (state->options->atoms) {
+    case RETF_ATOMS_EXISTING:
+      return retf_atom_cache_fetch(str_ptr, length,
+                                   is_module_name(str_ptr, length),
+                                   resolve_existing_atom);
+    case RETF_ATOMS_STRING: {
+      VALUE value = special_atom(str_ptr, length);
+      return value == Qundef ? atom_string(str_ptr, length) : value;
+    }
+    default:
+      return retf_atom_from_bytes(str_ptr, length);
   }
 }
 
-static VALUE decode_binary(decoder_state* state) {
-  uint32_t length = decode_int(state);
+static VALUE decode_atom(decoder_state* state, unsigned char tag) {
+  size_t length = decode_count(state, tag);
 
   if (RB_UNLIKELY(state->offset + length > state->buffer_size)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
   }
 
-  VALUE str = rb_str_new(state->buffer + state->offset, length);
-
+  const char *str_ptr = state->buffer + state->offset;
   state->offset += length;
 
-  return str;
+  return atom_from_input(state, str_ptr, length);
 }
 
-static VALUE decode_small_tuple(decoder_state* state) {
-  long arity = decode_byte(state);
-
-  VALUE tuple = rb_ary_new_capa(arity);
+static VALUE decode_atom_cache_ref(decoder_state* state) {
+  unsigned char index = decode_byte(state);
 
-  for (long i = 0; i < arity; i++) {
-    rb_ary_push(tuple, decode_term(state));
+  if (RB_UNLIKELY(index >= state->atom_ref_count)) {
+    rb_raise(rb_eArgError, "invalid atom cache reference");
   }
 
-  VALUE tuple_class = retf_constants_get_tuple_class();
+  return state->atom_refs[index];
+}
+
+static VALUE decode_any_atom(decoder_state* state) {
+  unsigned char tag = decode_byte(state);
 
-  return rb_funcall(tuple_class, rb_intern("from_array"), 1, tuple);
+  switch (tag) {
+    case 82:
+      return decode_atom_cache_ref(state);
+    case 115:
+    case 119:
+    case 100:
+    case 118:
+      return decode_atom(state, tag);
+    default:
+      rb_raise(rb_eArgError, "expected an atom tag, got %u", (unsigned int)tag);
+  }
 }
 
-static VALUE decode_large_tuple(decoder_state* state) {
-  uint32_t arity = decode_int(state);
+// Copies the next `length` bytes of the input into a new binary String,
+// or when enabled and the binary is large enough, returns a frozen
+// String which points into the input's buffer instead.
+static VALUE binary_from_input(decoder_state* state, size_t length) {
+  if (RB_UNLIKELY(state->offset + length > state->buffer_size)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+
+  size_t threshold = state->options->share_threshold;
+  VALUE str;
+
+  // rb_str_subseq only shares substrings which run to the end
+  // of the input, so build a static string pointing into it instead.
+  // That's only safe for inputs whose bytes live outside the object
+  // (embedded strings can move during compaction), and which are frozen
+  // so they're never reallocated. The input is kept alive through a
+  // hidden instance variable for as long as the substring is.
+  if (threshold != 0 && length >= threshold &&
+      RB_FL_TEST_RAW(state->source, RSTRING_NOEMBED)) {
+    rb_obj_freeze(state->source);
+
+    str = rb_str_new_static(state->buffer + state->offset, length);
+    rb_ivar_set(str, rb_intern("__retf_source__"), state->source);
+    rb_obj_freeze(str);
+  } else if (RB_LIKELY(length < RETF_NOGVL_COPY_MIN)) {
+    str = rb_str_new(state->buffer + state->offset, length);
+  } else {
+    str = rb_str_buf_new(length);
+
+    int error = retf_copy_bytes(RSTRING_PTR(str), state->source,
+                                state->buffer + state->offset, length);
 
-  VALUE tuple = rb_ary_new_capa(arity);
+    if (RB_UNLIKELY(error != 0)) {
+      rb_jump_tag(error);
+    }
 
-  for (uint32_t i = 0; i < arity; i++) {
-    rb_ary_push(tuple, decode_term(state));
+    rb_str_set_len(str, length);
   }
 
-  VALUE tuple_class = retf_constants_get_tuple_class();
+  state->offset += length;
 
-  return rb_funcall(tuple_class, rb_intern("from_array"), 1, tuple);
+  return str;
 }
 
-static VALUE decode_list(decoder_state* state) {
-  uint32_t length = decode_int(state);
+// Like `binary_from_input`, but with `dedup_binaries` enabled returns
+// short binaries as frozen Strings from Ruby's table of interned strings,
+// so that a key or value repeated throughout the input (or in every
+// message) is only kept once. Those are garbage collected like any other
+// string once nothing refers to them.
+static VALUE string_from_input(decoder_state* state, size_t length) {
+  if (length <= state->options->dedup_threshold &&
+      RB_LIKELY(state->offset + length <= state->buffer_size)) {
+    const char *str_ptr = state->buffer + state->offset;
+    state->offset += length;
+
+#ifdef HAVE_RB_ENC_INTERNED_STR
+    return rb_enc_interned_str(str_ptr, length, rb_ascii8bit_encoding());
+#else
+    return rb_funcall(rb_str_new(str_ptr, length), rb_intern("-@"), 0);
+#endif
+  }
 
-  VALUE list = rb_ary_new_capa(length + 1);
+  return binary_from_input(state, length);
+}
 
-  for (uint32_t i = 0; i < length + 1; i++) {
-    rb_ary_push(list, decode_term(state));
-  }
+static VALUE decode_binary(decoder_state* state) {
+  size_t length = decode_count(state, 109);
 
-  // For proper erlang lists the last element should be
-  // an empty list; If so, we'll remove it.
-  VALUE tail = rb_ary_entry(list, length);
+  return string_from_input(state, length);
+}
 
-  if (TYPE(tail) == T_ARRAY && rb_array_len(tail) == 0) {
-    rb_ary_pop(list);
-  }
+// Builds a Retf::Tuple the same way `Tuple.from_array` does,
+// without going through Ruby.
+static VALUE new_tuple(VALUE elements) {
+  rb_obj_freeze(elements);
 
-  return list;
+  VALUE tuple = rb_obj_alloc(retf_constants_get_tuple_class());
+  rb_ivar_set(tuple, retf_constants_get_value_ivar(), elements);
+  rb_ivar_set(tuple, retf_constants_get_size_ivar(),
+              LONG2FIX(RARRAY_LEN(elements)));
+
+  return tuple;
 }
 
 // This is for erlang style "strings" which are just a list of
 // integers that each fit in a byte.
 static VALUE decode_erl_string(decoder_state* state) {
-  uint16_t length = decode_short(state);
+  size_t length = decode_count(state, 107);
+
+  if (!state->options->byte_lists) {
+    return string_from_input(state, length);
+  }
 
   if (RB_UNLIKELY(state->offset + length > state->buffer_size)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
   }
 
-  VALUE str = rb_str_new(state->buffer + state->offset, length);
-
+  const unsigned char *bytes =
+      (const unsigned char *)state->buffer + state->offset;
   state->offset += length;
 
-  return str;
+  // Integers aren't heap objects, so they can be
+  // converted a chunk at a time and copied over.
+  VALUE list = rb_ary_new_capa(length);
+  VALUE chunk[256];
+
+  for (size_t i = 0; i < length; i += 256) {
+    size_t count = length - i < 256 ? length - i : 256;
+
+    for (size_t j = 0; j < count; j++) {
+      chunk[j] = INT2FIX(bytes[i + j]);
+    }
+
+    rb_ary_cat(list, chunk, count);
+  }
+
+  return list;
 }
 
-static VALUE decode_reference(decoder_state* state) {
-  VALUE reference_class = retf_constants_get_reference_class();
+// References and PIDs are built without calling `initialize`,
+// setting their instance variables in the same order it does.
 
-  uint16_t size = decode_short(state);
+// NEWER_REFERENCE_EXT (90) has a 4 byte creation,
+// NEW_REFERENCE_EXT (114) only 1.
+static VALUE decode_reference(decoder_state* state, int wide_creation) {
+  uint16_t size = decode_count(state, 90);
   VALUE node = decode_any_atom(state);
-  uint32_t creation = decode_int(state);
+  uint32_t creation = wide_creation ? decode_int(state) : decode_byte(state);
+
+  if (RB_UNLIKELY(state->offset + (size_t)size * 4 > state->buffer_size)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
 
   VALUE id = rb_ary_new_capa(size);
 
   for (uint16_t i = 0; i < size; i++) {
     uint32_t next_id = decode_int(state);
-    rb_ary_push(id, INT2FIX(next_id));
+    rb_ary_push(id, UINT2NUM(next_id));
   }
 
-  return rb_class_new_instance(3, (VALUE[]){INT2FIX(creation), id, node},
-                        reference_class);
-}
+  VALUE reference = rb_obj_alloc(retf_constants_get_reference_class());
+  rb_ivar_set(reference, retf_constants_get_node_ivar(), node);
+  rb_ivar_set(reference, retf_constants_get_creation_ivar(),
+              UINT2NUM(creation));
+  rb_ivar_set(reference, retf_constants_get_id_ivar(), id);
 
-static VALUE decode_pid(decoder_state* state) {
-  VALUE pid_class = retf_constants_get_pid_class();
+  return reference;
+}
 
+// NEW_PID_EXT (88) has a 4 byte creation, PID_EXT (103) only 1.
+static VALUE decode_pid(decoder_state* state, int wide_creation) {
   VALUE node = decode_any_atom(state);
   uint32_t id = decode_int(state);
   uint32_t serial = decode_int(state);
-  uint32_t creation = decode_int(state);
+  uint32_t creation = wide_creation ? decode_int(state) : decode_byte(state);
+
+  VALUE pid = rb_obj_alloc(retf_constants_get_pid_class());
+  rb_ivar_set(pid, retf_constants_get_node_ivar(), node);
+  rb_ivar_set(pid, retf_constants_get_id_ivar(), UINT2NUM(id));
+  rb_ivar_set(pid, retf_constants_get_serial_ivar(), UINT2NUM(serial));
+  rb_ivar_set(pid, retf_constants_get_creation_ivar(), UINT2NUM(creation));
 
-  return rb_class_new_instance(4, (VALUE[]){INT2FIX(id), INT2FIX(serial),
-                        INT2FIX(creation), node}, pid_class);
+  return pid;
 }
 
 static VALUE decode_bit_binary(decoder_state* state) {
-  VALUE bitstring_class = retf_constants_get_bitstring_class();
-
-  uint32_t size = decode_int(state);
+  size_t size = decode_count(state, 77);
 
   unsigned char bits = decode_byte(state);
 
-  if (RB_UNLIKELY(state->offset + size > state->buffer_size)) {
+  VALUE str = binary_from_input(state, size);
+
+  VALUE bit_binary = rb_obj_alloc(retf_constants_get_bitstring_class());
+  rb_ivar_set(bit_binary, retf_constants_get_binary_ivar(), str);
+  rb_ivar_set(bit_binary, retf_constants_get_bits_size_ivar(), INT2FIX(bits));
+
+  return bit_binary;
+}
+
+// Both SMALL_BIG_EXT and LARGE_BIG_EXT store the magnitude least
+// significant byte first, which rb_integer_unpack reads in one pass.
+static VALUE decode_bigint_bytes(decoder_state* state, size_t size, unsigned char sign) {
+  if (RB_UNLIKELY(size > state->buffer_size - state->offset)) {
     rb_raise(rb_eArgError, "Unexpected end of input");
   }
 
-  VALUE str = rb_str_new(state->buffer + state->offset, size);
+  int flags = INTEGER_PACK_LITTLE_ENDIAN;
+
+  if (sign != 0) {
+    flags |= INTEGER_PACK_NEGATIVE;
+  }
+
+  VALUE num = rb_integer_unpack(state->buffer + state->offset, size, 1, 0, flags);
 
   state->offset += size;
 
-  return rb_class_new_instance(2, (VALUE[]){str, INT2FIX(bits)},
-                        bitstring_class);
+  return num;
 }
 
-typedef struct {
-  const uint32_t map_length;
-  VALUE* kvp_arr;
-  decoder_state* state;
-} map_unpack_data;
+static VALUE decode_small_bigint(decoder_state* state) {
+  size_t size = decode_count(state, 110);
+  unsigned char sign = decode_byte(state);
 
-static VALUE decode_map_inner(VALUE unpack_data) {
-  map_unpack_data* data = (map_unpack_data*) unpack_data;
+  return decode_bigint_bytes(state, size, sign);
+}
 
-  VALUE map = rb_hash_new_capa(data->map_length);
-  decoder_state* state = data->state;
+static VALUE decode_large_bigint(decoder_state* state) {
+  size_t size = decode_count(state, 111);
+  unsigned char sign = decode_byte(state);
 
-  VALUE* kvp_arr = data->kvp_arr;
+  return decode_bigint_bytes(state, size, sign);
+}
 
-  size_t kvp_arr_len = data->map_length * 2;
+// Deflate can't do better than roughly 1032:1, so anything claiming
+// to inflate to more than this many times its size is malformed.
+#define RETF_MAX_DEFLATE_RATIO 1032
 
-  for (uint32_t i = 0; i < kvp_arr_len; i += 2) {
-    kvp_arr[i] = decode_term(state);
-    kvp_arr[i + 1] = decode_term(state);
-  }
+typedef struct {
+  z_stream stream;
+  const char *in_end;
+  char *out_end;
+  int status;
+} inflate_call;
 
-  rb_hash_bulk_insert(kvp_arr_len, kvp_arr, map);
+static int inflate_step(void *data) {
+  inflate_call *call = data;
+  z_stream *stream = &call->stream;
 
-  return map;
-}
+  size_t in_left = call->in_end - (const char *)stream->next_in;
+  size_t out_left = call->out_end - (char *)stream->next_out;
+  size_t out_step = out_left > RETF_NOGVL_STEP ? RETF_NOGVL_STEP : out_left;
 
-static VALUE decode_map(decoder_state* state) {
-  uint32_t length = decode_int(state);
+  stream->avail_in = in_left > UINT_MAX ? UINT_MAX : in_left;
+  stream->avail_out = out_step;
 
-  VALUE* kvp_arr = xmalloc2(length * 2, sizeof(VALUE));
+  call->status = inflate(stream, out_step == out_left ? Z_FINISH : Z_NO_FLUSH);
 
-  map_unpack_data data = {length, kvp_arr, state};
+  return call->status == Z_OK && (char *)stream->next_out != call->out_end &&
+         (const char *)stream->next_in != call->in_end;
+}
 
-  VALUE map =  rb_ensure(decode_map_inner, (VALUE)&data, free_unpack_data, (VALUE)kvp_arr);
+VALUE retf_inflate_term(decoder_state* state) {
+  uint32_t uncompressed_size = decode_count(state, 80);
 
-  VALUE struct_sym = retf_constants_get_struct();
+  const char *compressed = state->buffer + state->offset;
+  size_t compressed_size = state->buffer_size - state->offset;
 
-  VALUE struct_class = rb_hash_aref(map, rb_id2sym(struct_sym));
+  if (RB_UNLIKELY(uncompressed_size / RETF_MAX_DEFLATE_RATIO > compressed_size)) {
+    rb_raise(rb_eArgError,
+             "Decompressed data size does not match expected size");
+  }
 
-  if (RTEST(struct_class) &&
-      rb_respond_to(struct_class, rb_intern("from_etf"))) {
-    VALUE struct_instance =
-        rb_funcall(struct_class, rb_intern("from_etf"), 1, map);
-    return struct_instance;
+  size_t max_decompressed_bytes = state->options->max_decompressed_bytes;
+
+  if (RB_UNLIKELY(max_decompressed_bytes != 0 &&
+                  uncompressed_size > max_decompressed_bytes)) {
+    rb_raise(rb_eArgError, "compressed term inflates to more than "
+                           "max_decompressed_bytes");
   }
 
-  return map;
-}
+  int release_gvl = uncompressed_size >= RETF_NOGVL_ZLIB_MIN;
+  VALUE pinned = Qnil;
 
-typedef struct {
-  unsigned long* bytes;
-  size_t bytes_len;
-  unsigned char sign;
-} bigint_unpack_data;
+  if (release_gvl) {
+    pinned = retf_pin_bytes(state->source, &compressed);
+  }
 
-#ifdef HAVE_RB_BIG_UNPACK
-static VALUE unpack_bigint(VALUE data) {
-  bigint_unpack_data* unpack_data = (bigint_unpack_data*)data;
+  // The header tells us exactly how big the result should be,
+  // so inflate straight into a buffer of that size.
+  VALUE uncompressed_data = rb_str_buf_new(uncompressed_size);
+  char *out = RSTRING_PTR(uncompressed_data);
 
-  VALUE num = rb_big_unpack(unpack_data->bytes, unpack_data->bytes_len);
+  inflate_call call;
+  memset(&call, 0, sizeof(call));
 
-  if (unpack_data->sign != 0) {
-    num = rb_funcall(num, rb_intern("*"), 1, INT2FIX(-1));
+  if (inflateInit(&call.stream) != Z_OK) {
+    rb_raise(rb_eNoMemError, "failed to initialize zlib");
   }
 
-  return num;
-}
-#else
-static VALUE unpack_bigint(VALUE data) {
-  bigint_unpack_data* unpack_data = (bigint_unpack_data*)data;
+  call.stream.next_in = (Bytef *)compressed;
+  call.stream.next_out = (Bytef *)out;
+  call.in_end = compressed + compressed_size;
+  call.out_end = out + uncompressed_size;
 
-  VALUE num = INT2FIX(0);
-  VALUE two_fifty_six = INT2FIX(256);
+  retf_stats *stats = retf_stats_get();
+  uint64_t started = stats != NULL ? retf_stats_now() : 0;
 
-  unsigned char* buffer = (unsigned char*)unpack_data->bytes;
-  size_t size = unpack_data->bytes_len * sizeof(unsigned long);
+  int error = retf_run_steps(inflate_step, &call, release_gvl);
 
-  for (size_t i = 0; i < size; i++) {
-    unsigned char b = buffer[i];
-    VALUE byte_value = INT2FIX(b);
-    VALUE idx = INT2FIX(i);
+  int status = call.status;
+  size_t new_buffer_size = (char *)call.stream.next_out - out;
+  size_t consumed = (const char *)call.stream.next_in - compressed;
+  int output_full = new_buffer_size == uncompressed_size;
 
-    VALUE powed = rb_funcall(two_fifty_six, rb_intern("**"), 1, idx);
-    VALUE shifted = rb_funcall(byte_value, rb_intern("*"), 1, powed);
-    num = rb_funcall(num, rb_intern("+"), 1, shifted);
-  }
+  inflateEnd(&call.stream);
 
-  if (unpack_data->sign != 0) {
-    num = rb_funcall(num, rb_intern("*"), 1, INT2FIX(-1));
+  if (stats != NULL) {
+    retf_stats_count_zlib(&stats->inflate, consumed, new_buffer_size, started);
   }
 
-  return num;
-}
-#endif
+  RB_GC_GUARD(pinned);
 
-// This is a callback function for rb_ensure
-static VALUE free_unpack_data(VALUE data) {
-  xfree((void*) data);
-  return Qnil;
-}
+  if (RB_UNLIKELY(error != 0)) {
+    rb_jump_tag(error);
+  }
 
-static VALUE decode_small_bigint(decoder_state* state) {
-  unsigned char size = decode_byte(state);
-  unsigned char sign = decode_byte(state);
+  if (RB_UNLIKELY(status != Z_STREAM_END)) {
+    if (output_full) {
+      // There was more data than the header claimed
+      rb_raise(rb_eArgError,
+               "Decompressed data size does not match expected size");
+    } else if (status == Z_OK || status == Z_BUF_ERROR) {
+      rb_raise(rb_eArgError, "Unexpected end of input");
+    }
 
-  if (RB_UNLIKELY(state->offset + size > state->buffer_size)) {
-    rb_raise(rb_eArgError, "Unexpected end of input");
+    rb_raise(rb_eArgError, "malformed compressed data");
   }
 
-  // The rb_big_unpack function expects an array of longs
-  // but ETF bigints are stored as an array of bytes.
-  size_t bytes_needed = size / sizeof(unsigned long) + (size % sizeof(unsigned long) != 0);
+  if (RB_UNLIKELY(new_buffer_size != uncompressed_size)) {
+    rb_raise(rb_eArgError,
+             "Decompressed data size does not match expected size");
+  }
 
-  unsigned long* bytes = xcalloc(bytes_needed, sizeof(unsigned long));
+  rb_str_set_len(uncompressed_data, new_buffer_size);
+  state->offset += consumed;
 
-  memcpy(bytes, state->buffer + state->offset, size);
+  return uncompressed_data;
+}
 
-  state->offset += size;
+// With `freeze: true` every term is frozen as soon as it's decoded,
+// and marked as shareable between Ractors too if everything in it is.
+// That's what Ractor.make_shareable would do, but without it having to
+// walk the whole result again and keep track of what it has seen.
+static inline void mark_shareable(VALUE term) {
+#ifdef HAVE_RB_RACTOR_MAKE_SHAREABLE
+  RB_FL_SET_RAW(term, RUBY_FL_SHAREABLE);
+#endif
+}
 
-  bigint_unpack_data data = {bytes, bytes_needed, sign};
+static inline int all_shareable(const VALUE *terms, long count) {
+#ifdef HAVE_RB_RACTOR_MAKE_SHAREABLE
+  for (long i = 0; i < count; i++) {
+    if (!rb_ractor_shareable_p(terms[i])) {
+      return 0;
+    }
+  }
 
-  return rb_ensure(unpack_bigint, (VALUE)&data, free_unpack_data, (VALUE)bytes);
+  return 1;
+#else
+  return 0;
+#endif
 }
 
-static VALUE decode_large_bigint(decoder_state* state) {
-  uint32_t size = decode_int(state);
-  unsigned char sign = decode_byte(state);
+static VALUE freeze_leaf(VALUE term) {
+  if (RB_SPECIAL_CONST_P(term)) {
+    return term;
+  }
 
-  if (RB_UNLIKELY(state->offset + size > state->buffer_size)) {
-    rb_raise(rb_eArgError, "Unexpected end of input");
+  switch (RB_BUILTIN_TYPE(term)) {
+    case T_STRING:
+    case T_FLOAT:
+    case T_BIGNUM:
+    case T_ARRAY:
+      rb_obj_freeze(term);
+
+      // Binaries shared with the input refer to
+      // it through an instance variable.
+      if (!RB_FL_TEST_RAW(term, RUBY_FL_EXIVAR)) {
+        mark_shareable(term);
+        return term;
+      }
+
+      break;
+    case T_OBJECT:
+      // PIDs, references and bit binaries
+#ifndef HAVE_RB_RACTOR_MAKE_SHAREABLE
+      rb_obj_freeze(term);
+#endif
+      break;
+    default:
+      // Symbols and classes
+      return term;
   }
 
- // The rb_big_unpack function expects an array of longs
-  // but ETF bigints are stored as an array of bytes.
-  size_t bytes_needed = size / sizeof(unsigned long) + (size % sizeof(unsigned long) != 0);
+#ifdef HAVE_RB_RACTOR_MAKE_SHAREABLE
+  rb_ractor_make_shareable(term);
+#endif
 
-  unsigned long* bytes = xcalloc(bytes_needed, sizeof(unsigned long));
+  return term;
+}
 
-  memcpy(bytes, state->buffer + state->offset, size);
+// Builds a map, list or tuple out of the `count` terms it was made up of
+static VALUE build_container(unsigned char tag, const VALUE *values,
+                             long count, int freeze) {
+  switch (tag) {
+    case 104:
+    case 105: {
+      VALUE elements = rb_ary_new_from_values(count, values);
+      VALUE tuple = new_tuple(elements);
 
-  state->offset += size;
+      if (freeze) {
+        rb_obj_freeze(tuple);
 
-  bigint_unpack_data data = {bytes, bytes_needed, sign};
+        if (all_shareable(values, count)) {
+          mark_shareable(elements);
+          mark_shareable(tuple);
+        }
+      }
 
-  return rb_ensure(unpack_bigint, (VALUE)&data, free_unpack_data, (VALUE)bytes);
-}
+      return tuple;
+    }
+    case 108: {
+      // For proper erlang lists the last element should be
+      // an empty list; If so, we'll leave it out.
+      VALUE tail = values[count - 1];
 
-static VALUE decompress_data(decoder_state* state) {
-  uint32_t uncompressed_size = decode_int(state);
+      if (TYPE(tail) == T_ARRAY && rb_array_len(tail) == 0) {
+        count--;
+      }
 
-  VALUE zipped_str = rb_str_new(state->buffer + state->offset, state->buffer_size - state->offset);
+      VALUE list = rb_ary_new_from_values(count, values);
 
-  VALUE uncompressed_data = rb_funcall(retf_constants_get_zlib_inflate(),
-                                       rb_intern("inflate"), 1, zipped_str);
+      if (freeze) {
+        rb_obj_freeze(list);
 
-  size_t new_buffer_size = RSTRING_LEN(uncompressed_data);
+        if (all_shareable(values, count)) {
+          mark_shareable(list);
+        }
+      }
 
-  if (RB_UNLIKELY(new_buffer_size != uncompressed_size)) {
-    rb_raise(rb_eArgError,
-             "Decompressed data size does not match expected size");
+      return list;
+    }
+    default:
+      break;
   }
 
-  size_t new_offset = 0;
-  const char *new_buffer = RSTRING_PTR(uncompressed_data);
+  VALUE map = rb_hash_new_capa(count / 2);
+  rb_hash_bulk_insert(count, values, map);
 
-  decoder_state new_state = {new_buffer, new_buffer_size, new_offset};
+  VALUE struct_sym = retf_constants_get_struct();
 
-  VALUE term = decode_term(&new_state);
+  VALUE struct_class = rb_hash_aref(map, rb_id2sym(struct_sym));
 
-  RB_GC_GUARD(uncompressed_data);
+  // The map is left as it is for `from_etf`,
+  // and so is whatever that returns.
+  if (RTEST(struct_class) &&
+      rb_respond_to(struct_class, rb_intern("from_etf"))) {
+    retf_stats *stats = retf_stats_get();
 
-  return term;
+    if (stats != NULL) {
+      stats->from_etf++;
+    }
+
+    VALUE struct_instance =
+        rb_funcall(struct_class, rb_intern("from_etf"), 1, map);
+    return struct_instance;
+  }
+
+  if (freeze) {
+    rb_obj_freeze(map);
+
+    if (all_shareable(values, count)) {
+      mark_shareable(map);
+    }
+  }
+
+  return map;
 }
 
-static VALUE decode_term(decoder_state* state) {
-  unsigned char tag = decode_byte(state);
+// How many terms a map, list or tuple is made up of
+static size_t container_count(decoder_state* state, unsigned char tag) {
+  size_t count = decode_count(state, tag);
 
+  check_count(state, count);
+
+  return count;
+}
+
+// Anything other than a map, list, tuple or compressed term
+static VALUE decode_leaf(decoder_state* state, unsigned char tag) {
   switch (tag) {
     case 118:
     case 100:
-      return decode_atom(state);
     case 119:
     case 115:
-      return decode_small_atom(state);
+      return decode_atom(state, tag);
     case 109:
       return decode_binary(state);
     case 97:;
@@ -555,14 +934,8 @@ static VALUE decode_term(decoder_state* state) {
     case 98:;
       long num = decode_signed_int(state);
       return LONG2FIX(num);
-    case 116:
-      return decode_map(state);
-    case 104:
-      return decode_small_tuple(state);
     case 70:
       return decode_float(state);
-    case 108:
-      return decode_list(state);
     case 106:
       // 106 is for an empty list
       return rb_ary_new();
@@ -573,15 +946,17 @@ static VALUE decode_term(decoder_state* state) {
     case 111:
       return decode_large_bigint(state);
     case 88:
-      return decode_pid(state);
+      return decode_pid(state, 1);
+    case 103:
+      return decode_pid(state, 0);
     case 90:
-      return decode_reference(state);
-    case 105:
-      return decode_large_tuple(state);
+      return decode_reference(state, 1);
+    case 114:
+      return decode_reference(state, 0);
     case 77:
       return decode_bit_binary(state);
-    case 80:
-      return decompress_data(state);
+    case 82:
+      return decode_atom_cache_ref(state);
     default:
       rb_raise(rb_eArgError, "unexpected tag: %u", (unsigned int)tag);
   }
@@ -589,3 +964,167 @@ static VALUE decode_term(decoder_state* state) {
   // Should never get here
   return Qnil;
 }
+
+// A map, list, tuple or compressed term which is still being decoded
+typedef struct {
+  unsigned char tag;
+
+  // How many more terms it's made up of, and where
+  // the ones decoded so far start on the value stack.
+  size_t remaining;
+  size_t start;
+
+  // For compressed terms, the input to go
+  // back to once the term inside is decoded.
+  const char* buffer;
+  size_t buffer_size;
+  size_t offset;
+  VALUE source;
+} decode_frame;
+
+// Most terms fit in these without the stacks ever leaving the C stack
+#define RETF_DECODE_INLINE_FRAMES 16
+#define RETF_DECODE_INLINE_VALUES 64
+
+static VALUE decode_term(decoder_state* state, int compressed) {
+  decode_frame frame_storage[RETF_DECODE_INLINE_FRAMES];
+  VALUE value_storage[RETF_DECODE_INLINE_VALUES];
+
+  // The containers being decoded, innermost last, and the
+  // terms decoded for them which they're still waiting on.
+  retf_stack frames, values;
+  retf_stack_init(&frames, frame_storage, RETF_DECODE_INLINE_FRAMES);
+  retf_stack_init(&values, value_storage, RETF_DECODE_INLINE_VALUES);
+
+  size_t frame_count = 0;
+  size_t value_count = 0;
+
+  size_t max_terms = state->options->max_terms;
+  retf_stats *stats = retf_stats_get();
+
+  for (;;) {
+    if (RB_UNLIKELY(++state->terms > max_terms && max_terms != 0)) {
+      rb_raise(rb_eArgError, "input has more terms than max_terms");
+    }
+
+    size_t term_start = state->offset;
+    unsigned char tag = decode_byte(state);
+    VALUE value;
+
+    switch (tag) {
+      case 104:
+      case 105:
+      case 108:
+      case 116: {
+        size_t count = container_count(state, tag);
+        enter_container(state);
+
+        if (RB_UNLIKELY(stats != NULL)) {
+          retf_stats_count_tag(&stats->decoded, tag, state->offset - term_start);
+        }
+
+        if (count == 0) {
+          leave_container(state);
+          value = build_container(tag, NULL, 0, state->options->freeze);
+          break;
+        }
+
+        if (RB_UNLIKELY(frame_count == frames.capa)) {
+          retf_stack_grow(&frames, frame_count, sizeof(decode_frame));
+        }
+
+        decode_frame* frame = (decode_frame*)frames.items + frame_count++;
+        frame->tag = tag;
+        frame->remaining = count;
+        frame->start = value_count;
+        continue;
+      }
+      case 80: {
+        // Only the root term may be compressed, as in erts. Allowing
+        // it anywhere lets every nested term inflate up to the limit.
+        if (RB_UNLIKELY(!compressed || frame_count != 0)) {
+          rb_raise(rb_eArgError, "unexpected tag: %u", (unsigned int)tag);
+        }
+
+        VALUE uncompressed_data = retf_inflate_term(state);
+
+        if (RB_UNLIKELY(stats != NULL)) {
+          retf_stats_count_tag(&stats->decoded, tag, state->offset - term_start);
+        }
+
+        if (RB_UNLIKELY(frame_count == frames.capa)) {
+          retf_stack_grow(&frames, frame_count, sizeof(decode_frame));
+        }
+
+        decode_frame* frame = (decode_frame*)frames.items + frame_count++;
+        frame->tag = tag;
+        frame->buffer = state->buffer;
+        frame->buffer_size = state->buffer_size;
+        frame->offset = state->offset;
+        frame->source = state->source;
+
+        // The uncompressed data is kept alive as the
+        // source until the term inside it is decoded.
+        state->buffer = RSTRING_PTR(uncompressed_data);
+        state->buffer_size = RSTRING_LEN(uncompressed_data);
+        state->offset = 0;
+        state->source = uncompressed_data;
+        continue;
+      }
+      default:
+        value = decode_leaf(state, tag);
+
+        if (RB_UNLIKELY(stats != NULL)) {
+          retf_stats_count_tag(&stats->decoded, tag, state->offset - term_start);
+        }
+
+        if (RB_UNLIKELY(state->options->freeze)) {
+          value = freeze_leaf(value);
+        }
+
+        break;
+    }
+
+    // Hand the term to the container it's in, and
+    // finish off every container that completes.
+    for (;;) {
+      if (frame_count == 0) {
+        retf_stack_free(&frames);
+        retf_stack_free(&values);
+
+        return value;
+      }
+
+      decode_frame* frame = (decode_frame*)frames.items + frame_count - 1;
+
+      if (frame->tag == 80) {
+        state->buffer = frame->buffer;
+        state->buffer_size = frame->buffer_size;
+        state->offset = frame->offset;
+        state->source = frame->source;
+
+        frame_count--;
+        continue;
+      }
+
+      if (RB_UNLIKELY(value_count == values.capa)) {
+        retf_stack_grow(&values, value_count, sizeof(VALUE));
+      }
+
+      ((VALUE*)values.items)[value_count++] = value;
+
+      if (--frame->remaining > 0) {
+        break;
+      }
+
+      size_t start = frame->start;
+
+      value = build_container(frame->tag, (VALUE*)values.items + start,
+                              value_count - start, state->options->freeze);
+
+      value_count = start;
+      frame_count--;
+      leave_container(state);
+    }
+  }
+}
@@ -1,15 +1,125 @@
+#ifndef RETF_DECODE_H
+#define RETF_DECODE_H
+
 #include <endian.h>
+#include <limits.h>
 #include <ruby.h>
+#include <ruby/encoding.h>
+#ifdef HAVE_RUBY_RACTOR_H
+#include <ruby/ractor.h>
+#endif
 #include <stdint.h>
 #include <string.h>
 #include <zlib.h>
 
+#include "atom_cache.h"
 #include "constants.h"
+#include "nogvl.h"
+#include "packet.h"
+#include "stack.h"
+#include "stats.h"
+
+// Binaries at least this many bytes long are returned as shared
+// substrings of the input when `share_binaries: true` is given.
+#define RETF_DEFAULT_SHARE_THRESHOLD 1024
+
+// Binaries at most this many bytes long are returned as deduplicated
+// frozen strings when `dedup_binaries: true` is given.
+#define RETF_DEFAULT_DEDUP_THRESHOLD 64
+
+// What atoms are decoded into, set by `atoms:`
+enum {
+    // Symbols, interning any which don't exist yet
+    RETF_ATOMS_SYMBOL = 0,
+    // Symbols which already exist, and frozen Strings for the rest
+    RETF_ATOMS_EXISTING,
+    // Frozen Strings
+    RETF_ATOMS_STRING,
+};
+
+typedef struct {
+    // 0 when binaries should always be copied out of the input
+    size_t share_threshold;
+
+    // 0 when binaries should never be deduplicated
+    size_t dedup_threshold;
+
+    // One of the RETF_ATOMS_ modes above
+    int atoms;
+
+    // Whether to freeze everything decoded, see `freeze_leaf`
+    int freeze;
+
+    // Whether STRING_EXT is decoded into an Array of Integers
+    // rather than a String, set by `byte_lists: :array`
+    int byte_lists;
+
+    // Limits for decoding untrusted input, 0 for no limit.
+    // How deeply maps, lists and tuples may be nested
+    size_t max_depth;
+    // How long the input may be
+    size_t max_bytes;
+    // How many terms may be decoded in total
+    size_t max_terms;
+    // How large a compressed term may inflate to
+    size_t max_decompressed_bytes;
+} decoder_options;
 
 typedef struct {
     const char* buffer;
-    const size_t buffer_size;
+    size_t buffer_size;
     size_t offset;
+    // The Ruby string `buffer` points into, which changes
+    // to the uncompressed data inside compressed terms.
+    VALUE source;
+    const decoder_options* options;
+    // The atoms ATOM_CACHE_REF indexes into, set
+    // for the terms after a distribution header.
+    const VALUE* atom_refs;
+    size_t atom_ref_count;
+    // How deeply nested the term being decoded is,
+    // and how many terms have been decoded so far.
+    size_t depth;
+    size_t terms;
 } decoder_state;
 
-VALUE retf_decode(VALUE self, VALUE str, VALUE skip_version_check);
+VALUE retf_decode(VALUE self, VALUE str, VALUE skip_version_check,
+                  VALUE share_binaries, VALUE max_depth, VALUE max_bytes,
+                  VALUE max_terms, VALUE max_decompressed_bytes,
+                  VALUE freeze, VALUE atoms, VALUE dedup_binaries,
+                  VALUE byte_lists);
+
+VALUE retf_decode_many(VALUE self, VALUE str, VALUE packet,
+                       VALUE share_binaries, VALUE atoms,
+                       VALUE dedup_binaries, VALUE byte_lists,
+                       VALUE max_depth, VALUE max_bytes, VALUE max_terms,
+                       VALUE max_decompressed_bytes);
+
+// Parses `atoms:` into one of the RETF_ATOMS_ modes,
+// nil is the same as :symbol.
+int retf_parse_atoms(VALUE atoms);
+
+// Parses `dedup_binaries:` into the longest binary to deduplicate.
+size_t retf_parse_dedup_binaries(VALUE dedup_binaries);
+
+// Parses `byte_lists:`, returning whether it's :array,
+// nil is the same as :string.
+int retf_parse_byte_lists(VALUE byte_lists);
+
+// Parses the `max_` limits into `options`, nil for no limit
+void retf_parse_limits(decoder_options* options, VALUE max_depth,
+                       VALUE max_bytes, VALUE max_terms,
+                       VALUE max_decompressed_bytes);
+
+// Resolves atom text into a Symbol, true, false, nil or Elixir
+// module through the atom cache, as `atoms: :symbol` does.
+VALUE retf_atom_from_bytes(const char *str_ptr, size_t length);
+
+// Decodes the term at `state->offset`, leaving the offset just past it.
+VALUE retf_decode_state(decoder_state* state, int check_version);
+
+// Inflates the compressed term (tag 80) whose uncompressed size is at
+// `state->offset`, returning the uncompressed term in a new String.
+VALUE retf_inflate_term(decoder_state* state);
+
+#endif  // RETF_DECODE_H
@@ -0,0 +1,303 @@
+#include "dist_atom_cache.h"
+
+#include "atom_cache.h"
+#include "decode.h"
+#include "encode.h"
+
+static void dist_cache_mark(void *ptr) {
+  retf_dist_cache *cache = ptr;
+
+  for (size_t i = 0; i < RETF_DIST_CACHE_SLOTS; i++) {
+    rb_gc_mark(cache->received[i]);
+
+    // Dynamic symbols must stay alive while cached, otherwise
+    // a new one allocated at the same address would be
+    // mistaken for the one the other node already has.
+    if (!RB_SPECIAL_CONST_P(cache->sent[i])) {
+      rb_gc_mark(cache->sent[i]);
+    }
+  }
+}
+
+static size_t dist_cache_memsize(const void *ptr) {
+  return sizeof(retf_dist_cache);
+}
+
+static const rb_data_type_t dist_cache_type = {
+    "Retf::AtomCache",
+    {dist_cache_mark, RUBY_TYPED_DEFAULT_FREE, dist_cache_memsize},
+    0, 0, RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static void clear_cache(retf_dist_cache *cache) {
+  for (size_t i = 0; i < RETF_DIST_CACHE_SLOTS; i++) {
+    cache->received[i] = Qnil;
+
+    // false is a valid key, so empty slots need something
+    // which can never be encoded.
+    cache->sent[i] = Qundef;
+  }
+}
+
+static VALUE dist_cache_alloc(VALUE klass) {
+  retf_dist_cache *cache;
+  VALUE self =
+      TypedData_Make_Struct(klass, retf_dist_cache, &dist_cache_type, cache);
+
+  clear_cache(cache);
+
+  return self;
+}
+
+static retf_dist_cache *get_cache(VALUE self) {
+  retf_dist_cache *cache;
+  TypedData_Get_Struct(self, retf_dist_cache, &dist_cache_type, cache);
+  return cache;
+}
+
+void retf_dist_refer_to_atom(retf_writer *writer, VALUE key, size_t start) {
+  retf_dist_refs *refs = writer->dist_refs;
+
+  const char *encoded = writer->ptr + start;
+  size_t header = encoded[0] == 119 ? 2 : 3;
+  const char *text = encoded + header;
+  size_t len = writer->len - start - header;
+
+  size_t slot = retf_hash_bytes(text, len) & (RETF_DIST_CACHE_SLOTS - 1);
+  int ref = refs->ref_of_slot[slot];
+
+  if (ref < 0) {
+    if (refs->count == RETF_DIST_MAX_REFS) {
+      return;
+    }
+
+    ref = refs->count++;
+    refs->slot[ref] = slot;
+    refs->key[ref] = key;
+    refs->is_new[ref] = refs->cache->sent[slot] != key;
+    refs->ref_of_slot[slot] = ref;
+
+    if (refs->is_new[ref]) {
+      refs->long_atoms |= len > 255;
+      retf_writer_put_be16(&refs->texts, len);
+      retf_writer_put_bytes(&refs->texts, text, len);
+    }
+  } else if (refs->key[ref] != key) {
+    // Another atom in this message already
+    // took the slot, so spell this one out.
+    return;
+  }
+
+  writer->len = start;
+  retf_writer_put_byte(writer, 82);
+  retf_writer_put_byte(writer, ref);
+}
+
+static void write_header(retf_writer *writer, retf_dist_refs *refs) {
+  int count = refs->count;
+
+  retf_writer_put_byte(writer, 131);
+  retf_writer_put_byte(writer, 68);
+  retf_writer_put_byte(writer, count);
+
+  if (count == 0) {
+    return;
+  }
+
+  // Four bits per reference, the new entry flag then the
+  // segment, followed by four more for the long atoms flag.
+  unsigned char flags[RETF_DIST_MAX_REFS / 2 + 1] = {0};
+
+  for (int i = 0; i < count; i++) {
+    unsigned char nibble = (refs->is_new[i] << 3) | (refs->slot[i] >> 8);
+    flags[i / 2] |= nibble << ((i % 2) * 4);
+  }
+
+  flags[count / 2] |= refs->long_atoms << ((count % 2) * 4);
+
+  retf_writer_put_bytes(writer, flags, count / 2 + 1);
+
+  const char *text = refs->texts.ptr;
+
+  for (int i = 0; i < count; i++) {
+    retf_writer_put_byte(writer, refs->slot[i] & 0xFF);
+
+    if (!refs->is_new[i]) {
+      continue;
+    }
+
+    uint16_t len;
+    memcpy(&len, text, 2);
+    len = be16toh(len);
+
+    if (refs->long_atoms) {
+      retf_writer_put_be16(writer, len);
+    } else {
+      retf_writer_put_byte(writer, len);
+    }
+
+    retf_writer_put_bytes(writer, text + 2, len);
+    text += 2 + len;
+  }
+}
+
+/*
+ * Encodes +terms+ behind a distribution header, writing atoms as
+ * references into this cache where possible. Atoms which aren't
+ * cached yet are added to it through the header.
+ *
+ * As in the distribution protocol, the terms don't
+ * have version bytes of their own.
+ *
+ * Every argument is a term, so there's no room for options and
+ * lists are always written as lists, as with <tt>byte_lists: false</tt>.
+ */
+static VALUE dist_cache_encode(int argc, VALUE *argv, VALUE self) {
+  retf_dist_cache *cache = get_cache(self);
+
+  retf_dist_refs refs;
+  refs.cache = cache;
+  refs.count = 0;
+  refs.long_atoms = 0;
+  memset(refs.ref_of_slot, 0xFF, sizeof(refs.ref_of_slot));
+
+  VALUE texts = rb_str_buf_new(0);
+  retf_writer_init(&refs.texts, texts);
+
+  VALUE body = rb_str_buf_new(1024);
+  retf_writer body_writer;
+  retf_writer_init(&body_writer, body);
+  body_writer.dist_refs = &refs;
+
+  for (int i = 0; i < argc; i++) {
+    retf_encode_term(argv[i], &body_writer, 0);
+  }
+
+  VALUE str_buffer = rb_str_buf_new(body_writer.len + 64);
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+
+  write_header(&writer, &refs);
+  retf_writer_put_bytes(&writer, body_writer.ptr, body_writer.len);
+
+  // Everything was encoded, so the other node will now have these
+  for (int i = 0; i < refs.count; i++) {
+    if (refs.is_new[i]) {
+      cache->sent[refs.slot[i]] = refs.key[i];
+    }
+  }
+
+  RB_GC_GUARD(texts);
+  RB_GC_GUARD(body);
+
+  return retf_writer_finish(&writer);
+}
+
+static void check_remaining(size_t offset, size_t needed, size_t size) {
+  if (RB_UNLIKELY(needed > size - offset)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+}
+
+/*
+ * Decodes the terms following a distribution header, updating
+ * this cache with the atoms it defines and resolving atom cache
+ * references against it. Returns the terms in an Array.
+ */
+static VALUE dist_cache_decode(VALUE self, VALUE str) {
+  retf_dist_cache *cache = get_cache(self);
+
+  Check_Type(str, T_STRING);
+
+  const unsigned char *buffer = (const unsigned char *)RSTRING_PTR(str);
+  size_t size = RSTRING_LEN(str);
+
+  if (size < 2 || buffer[0] != 131 || buffer[1] != 68) {
+    rb_raise(rb_eArgError, "expected a distribution header");
+  }
+
+  size_t offset = 2;
+
+  check_remaining(offset, 1, size);
+  int count = buffer[offset++];
+
+  VALUE refs[RETF_DIST_MAX_REFS];
+
+  if (count > 0) {
+    size_t flags_len = count / 2 + 1;
+    check_remaining(offset, flags_len, size);
+
+    const unsigned char *flags = buffer + offset;
+    offset += flags_len;
+
+    int long_atoms = (flags[count / 2] >> ((count % 2) * 4)) & 1;
+
+    for (int i = 0; i < count; i++) {
+      unsigned char nibble = (flags[i / 2] >> ((i % 2) * 4)) & 0xF;
+
+      check_remaining(offset, 1, size);
+      size_t slot = ((nibble & 7) << 8) | buffer[offset++];
+
+      if (nibble & 8) {
+        size_t len;
+
+        if (long_atoms) {
+          check_remaining(offset, 2, size);
+          len = (buffer[offset] << 8) | buffer[offset + 1];
+          offset += 2;
+        } else {
+          check_remaining(offset, 1, size);
+          len = buffer[offset++];
+        }
+
+        check_remaining(offset, len, size);
+
+        const char *text = (const char *)buffer + offset;
+        offset += len;
+
+        cache->received[slot] = rb_obj_freeze(rb_str_new(text, len));
+        refs[i] = retf_atom_from_bytes(text, len);
+      } else {
+        VALUE text = cache->received[slot];
+
+        if (NIL_P(text)) {
+          rb_raise(rb_eArgError, "atom cache reference to an empty slot");
+        }
+
+        refs[i] = retf_atom_from_bytes(RSTRING_PTR(text), RSTRING_LEN(text));
+      }
+    }
+  }
+
+  decoder_options options = {0};
+  decoder_state state = {(const char *)buffer, size, offset, str, &options,
+                         refs, count};
+
+  VALUE terms = rb_ary_new();
+
+  while (state.offset < size) {
+    rb_ary_push(terms, retf_decode_state(&state, 0));
+  }
+
+  RB_GC_GUARD(str);
+
+  return terms;
+}
+
+/*
+ * Forgets every cached atom, for when the
+ * connection it mirrors is re-established.
+ */
+static VALUE dist_cache_clear(VALUE self) {
+  clear_cache(get_cache(self));
+  return self;
+}
+
+void retf_dist_atom_cache_setup(VALUE mRetf) {
+  VALUE cAtomCache = rb_define_class_under(mRetf, "AtomCache", rb_cObject);
+
+  rb_define_alloc_func(cAtomCache, dist_cache_alloc);
+  rb_define_method(cAtomCache, "encode", dist_cache_encode, -1);
+  rb_define_method(cAtomCache, "decode", dist_cache_decode, 1);
+  rb_define_method(cAtomCache, "clear", dist_cache_clear, 0);
+}
@@ -0,0 +1,58 @@
+#ifndef RETF_DIST_ATOM_CACHE_H
+#define RETF_DIST_ATOM_CACHE_H
+
+#include <ruby.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "writer.h"
+
+// The distribution atom cache is split into 8
+// segments of 256 atoms each.
+#define RETF_DIST_CACHE_SLOTS 2048
+
+// A header has a single byte for the number of references
+#define RETF_DIST_MAX_REFS 255
+
+// The atom cache of one end of a connection. Unlike
+// the process wide atom cache this mirrors the other
+// node's, so every slot is significant.
+typedef struct {
+  // Atom text (frozen Strings) received in distribution headers
+  VALUE received[RETF_DIST_CACHE_SLOTS];
+
+  // The Symbol (or Class etc.) last sent in each slot,
+  // 0 if nothing has been.
+  VALUE sent[RETF_DIST_CACHE_SLOTS];
+} retf_dist_cache;
+
+// The atoms referenced by one message being encoded. New entries
+// only make it into the cache once the whole message has been
+// encoded, otherwise an error halfway through would leave the cache
+// believing the other node has atoms which were never sent.
+struct retf_dist_refs {
+  retf_dist_cache *cache;
+  int count;
+  int long_atoms;
+  uint16_t slot[RETF_DIST_MAX_REFS];
+  unsigned char is_new[RETF_DIST_MAX_REFS];
+  VALUE key[RETF_DIST_MAX_REFS];
+
+  // Which reference each slot is used by, -1 if none
+  int16_t ref_of_slot[RETF_DIST_CACHE_SLOTS];
+
+  // The length and text of each new entry,
+  // in the same order as the references.
+  retf_writer texts;
+};
+
+typedef struct retf_dist_refs retf_dist_refs;
+
+// Rewrites the complete atom encoding (tag, length and text)
+// between `start` and the end of the writer as a reference into
+// the header being built, unless the atom can't be cached.
+void retf_dist_refer_to_atom(retf_writer *writer, VALUE key, size_t start);
+
+void retf_dist_atom_cache_setup(VALUE mRetf);
+
+#endif  // RETF_DIST_ATOM_CACHE_H
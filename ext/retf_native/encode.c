@@ -1,357 +1,1188 @@
 #include "encode.h"
 
-static VALUE encode_fixed_integer(long val, VALUE str_buffer);
-static VALUE encode_big_integer(VALUE bigint, VALUE str_buffer);
-static VALUE encode_any_integer(VALUE self, VALUE str_buffer);
-static VALUE encode_float(VALUE self, VALUE str_buffer);
-static VALUE encode_string(VALUE self, VALUE str_buffer);
-static VALUE encode_array(VALUE self, VALUE str_buffer);
-static VALUE encode_map(VALUE self, VALUE str_buffer);
-static VALUE encode_atom(VALUE self, VALUE str_buffer);
-static VALUE encode_class(VALUE self, VALUE str_buffer);
-static VALUE encode_object(VALUE self, VALUE str_buffer);
-
-static int encode_hash_pair(VALUE key, VALUE value, VALUE buffer);
-static VALUE compress_data(VALUE str_buffer);
-static VALUE encode_term(VALUE term, VALUE str_buffer);
+static void encode_fixed_integer(long val, retf_writer *writer);
+static void encode_big_integer(VALUE bigint, retf_writer *writer);
+static void encode_any_integer(VALUE self, retf_writer *writer);
+static void encode_float(VALUE self, retf_writer *writer);
+static void encode_string(VALUE self, retf_writer *writer);
+static void encode_atom(VALUE self, retf_writer *writer);
+static void encode_class(VALUE self, retf_writer *writer);
+static void encode_pid(VALUE self, retf_writer *writer);
+static void encode_reference(VALUE self, retf_writer *writer);
+static void encode_bit_binary(VALUE self, retf_writer *writer);
+
+static VALUE compress_data(VALUE str_buffer, int level);
+static void encode_node(VALUE self, retf_writer *writer);
+
+// Lists of hashes usually share their keys (rows from a database and
+// the like), so the encoded Symbol keys of the previous hash are kept
+// and copied over when the next one has the same keys in the same
+// order. Hashes with more or longer keys than fit here still have
+// their first few keys copied.
+#define RETF_SHAPE_MAX_KEYS 32
+#define RETF_SHAPE_MAX_BYTES 512
+
+typedef struct {
+  // The keys of the shape, and where the encoding
+  // of each ends in `bytes`.
+  VALUE keys[RETF_SHAPE_MAX_KEYS];
+  uint16_t ends[RETF_SHAPE_MAX_KEYS];
+  long count;
+
+  // The position within the hash being encoded, and
+  // whether its keys have matched the shape so far.
+  long index;
+  int matching;
+
+  char bytes[RETF_SHAPE_MAX_BYTES];
+} retf_shape;
+
+// A map, list or tuple whose elements are still being encoded
+typedef struct {
+  // What was pushed, to spot terms which contain themselves
+  VALUE source;
+
+  // The elements left to encode are `elements[index...len]`. For
+  // maps these are instead the keys and values in turn, copied onto
+  // the encoder's pair stack from `start` onwards, from the first
+  // pair which couldn't be written straight away.
+  VALUE elements;
+  size_t start;
+  long index;
+  long len;
+  int pairs;
+
+  // Written after the last element, 106 (the empty list) for lists
+  unsigned char tail;
+
+  // The shape of a list of hashes, which the maps in it point to
+  // as well. It belongs to the list's frame, and lives in a buffer
+  // of its own unless it's the encoder's spare.
+  retf_shape *shape;
+  VALUE shape_buffer;
+} encode_frame;
+
+typedef struct {
+  retf_writer *writer;
+
+  // Frames for the maps, lists and tuples being
+  // encoded, from the outermost to the innermost.
+  retf_stack frames;
+  size_t depth;
+
+  // The keys and values still to be encoded for map frames
+  retf_stack pairs;
+  size_t pair_count;
+
+  // 0 when there's no limit
+  size_t max_depth;
+
+  // Whether lists of integers between 0 and 255 are written
+  // as STRING_EXT, which is how `term_to_binary` writes them.
+  int byte_lists;
+
+  // A shape on the C stack for the first list of hashes to use,
+  // NULL while one is. Lists nested inside it get their own.
+  retf_shape *spare_shape;
+
+  // NULL unless stats are enabled. The keys and values of a map can
+  // be written while writing the map, `stats_nested` adds up their
+  // bytes so they're taken off the map's rather than counted twice.
+  retf_stats *stats;
+  size_t stats_nested;
+  int stats_skip;
+} retf_encoder;
+
+// Where a term being counted started, counted from the start
+// of the output since writing to an IO may flush the buffer.
+typedef struct {
+  size_t start;
+  size_t nested;
+} stats_mark;
+
+// Most terms fit in these without the stacks ever leaving the C stack
+#define RETF_ENCODE_INLINE_FRAMES 16
+#define RETF_ENCODE_INLINE_PAIRS 64
+
+// Until this deep every new frame is compared against all
+// the others, to catch terms which contain themselves.
+#define RETF_CYCLE_SCAN_DEPTH 32
+
+static void encode_value(retf_encoder *enc, VALUE term);
+static void encode_array(retf_encoder *enc, VALUE self);
+static void encode_map(retf_encoder *enc, VALUE self, retf_shape *shape);
+static void encode_root_map(retf_encoder *enc, VALUE self);
+static void encode_shaped_map(retf_encoder *enc, VALUE self,
+                              retf_shape *shape);
+static void encode_object(retf_encoder *enc, VALUE self);
+static void encode_tuple(retf_encoder *enc, VALUE self);
+
+// The string to append to, given as the optional
+// argument of the `to_etf` methods.
+static inline VALUE scan_buffer(int argc, VALUE *argv) {
+  rb_check_arity(argc, 0, 1);
+
+  if (argc == 0) {
+    return rb_str_buf_new(10);
+  }
+
+  Check_Type(argv[0], T_STRING);
+  return argv[0];
+}
 
 // Helper function to deduplicate the logic of scanning arguments
 // and calling the actual encoding function.
 static inline VALUE scan_and_call(int argc, VALUE *argv, VALUE self,
-                           VALUE (*func)(VALUE self, VALUE str_buffer)) {
-  VALUE str_buffer;
+                           void (*func)(VALUE self, retf_writer *writer)) {
+  VALUE str_buffer = scan_buffer(argc, argv);
 
-  if (argc == 0) {
-    str_buffer = rb_str_buf_new(10);
-  } else {
-    str_buffer = argv[0];
-    Check_Type(str_buffer, T_STRING);
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+
+  func(self, &writer);
+
+  return retf_writer_finish(&writer);
+}
+
+static inline void encode_with(VALUE term, retf_writer *writer,
+                               size_t max_depth, int byte_lists,
+                               void (*begin)(retf_encoder *enc, VALUE term));
+
+// The same for maps, lists and tuples, which `begin` starts
+// encoding before the encoder takes care of their elements.
+static inline VALUE scan_and_encode(int argc, VALUE *argv, VALUE self,
+                             void (*begin)(retf_encoder *enc, VALUE self)) {
+  VALUE str_buffer = scan_buffer(argc, argv);
+
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+
+  encode_with(self, &writer, 0, 0, begin);
+
+  return retf_writer_finish(&writer);
+}
+
+// Z_DEFAULT_COMPRESSION is already -1
+#define RETF_UNCOMPRESSED -2
+
+// Returns the zlib level to compress with, or RETF_UNCOMPRESSED.
+// Mirrors the `compressed` and `{compressed, Level}` options of
+// `term_to_binary/2`.
+static int parse_compression_level(VALUE compress) {
+  if (!RTEST(compress)) {
+    return RETF_UNCOMPRESSED;
+  }
+
+  if (compress == Qtrue) {
+    return Z_DEFAULT_COMPRESSION;
+  }
+
+  int level = NUM2INT(compress);
+
+  if (level < 0 || level > 9) {
+    rb_raise(rb_eArgError, "compression level must be between 0 and 9");
   }
 
-  return func(self, str_buffer);
+  return level;
 }
 
-VALUE retf_encode(VALUE self, VALUE to_encode, VALUE compress) {
+VALUE retf_encode(VALUE self, VALUE to_encode, VALUE compress,
+                  VALUE compress_threshold, VALUE max_depth,
+                  VALUE byte_lists) {
+  int level = parse_compression_level(compress);
+  size_t threshold = NIL_P(compress_threshold) ? 0 : NUM2SIZET(compress_threshold);
+  size_t depth_limit = retf_parse_limit(max_depth, "max_depth");
+
   VALUE str_buffer = rb_str_buf_new(1024);
 
-  if (RTEST(compress)) {
-    encode_term(to_encode, str_buffer);
-    return compress_data(str_buffer);
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+
+  retf_writer_put_byte(&writer, 131);
+  encode_with(to_encode, &writer, depth_limit, RTEST(byte_lists),
+              encode_value);
+  retf_writer_finish(&writer);
+
+  // Small terms aren't worth compressing, the version
+  // byte doesn't count towards the threshold.
+  if (level == RETF_UNCOMPRESSED || writer.len - 1 < threshold) {
+    return str_buffer;
   }
 
-  rb_str_cat(str_buffer, "\x83", 1);
-  encode_term(to_encode, str_buffer);
+  return compress_data(str_buffer, level);
+}
+
+VALUE retf_encode_to(VALUE self, VALUE io, VALUE to_encode,
+                     VALUE byte_lists) {
+  VALUE str_buffer = rb_str_buf_new(RETF_WRITER_IO_CAPA);
+
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+  writer.io = io;
+
+  retf_writer_put_byte(&writer, 131);
+  encode_with(to_encode, &writer, 0, RTEST(byte_lists), encode_value);
+
+  if (writer.len > 0) {
+    retf_writer_write_io(&writer, Qnil);
+  }
 
-  return str_buffer;
+  RB_GC_GUARD(str_buffer);
+
+  return SIZET2NUM(writer.flushed);
 }
 
-static inline void ensure_str_extra_capacity(VALUE str, size_t required) {
-  size_t cap = rb_str_capacity(str);
-  size_t len = RSTRING_LEN(str);
+VALUE retf_encode_many(VALUE self, VALUE values, VALUE packet,
+                       VALUE byte_lists) {
+  Check_Type(values, T_ARRAY);
+
+  int prefix = retf_parse_packet(packet);
+  size_t max_size = prefix != 0 ? retf_packet_max(prefix) : SIZE_MAX;
+
+  VALUE str_buffer = rb_str_buf_new(1024);
 
-  if (len + required < cap) {
-    rb_str_modify_expand(str, required);
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+
+  // The length is checked every time since
+  // `to_etf` methods may change the array.
+  for (long i = 0; i < RARRAY_LEN(values); i++) {
+    // Leave room for the length and fill it in afterwards
+    retf_writer_reserve(&writer, prefix);
+    size_t start = writer.len + prefix;
+    writer.len = start;
+
+    retf_writer_put_byte(&writer, 131);
+    encode_with(RARRAY_AREF(values, i), &writer, 0, RTEST(byte_lists),
+                encode_value);
+
+    size_t size = writer.len - start;
+
+    if (RB_UNLIKELY(size > max_size)) {
+      rb_raise(rb_eArgError, "encoded term is too large for a %d byte length",
+               prefix);
+    }
+
+    retf_packet_write(writer.ptr + start - prefix, prefix, size);
   }
+
+  return retf_writer_finish(&writer);
 }
 
-static VALUE compress_data(VALUE str_buffer) {
-  size_t len = RSTRING_LEN(str_buffer);
+typedef struct {
+  z_stream stream;
+  const char *in_end;
+  char *out_end;
+  int status;
+} deflate_call;
+
+static int deflate_step(void *data) {
+  deflate_call *call = data;
+  z_stream *stream = &call->stream;
+
+  size_t in_left = call->in_end - (const char *)stream->next_in;
+  size_t out_left = call->out_end - (char *)stream->next_out;
+  size_t in_step = in_left > RETF_NOGVL_STEP ? RETF_NOGVL_STEP : in_left;
+
+  // avail_out is only 32 bits, so the output buffer
+  // is handed over in pieces if it's larger than that.
+  stream->avail_in = in_step;
+  stream->avail_out = out_left > UINT_MAX ? UINT_MAX : out_left;
+
+  call->status = deflate(stream, in_step == in_left ? Z_FINISH : Z_NO_FLUSH);
+
+  return call->status == Z_OK;
+}
+
+// Deflates an already encoded term (including its version byte)
+// straight into a new string after the compressed term header.
+static VALUE compress_data(VALUE str_buffer, int level) {
+  // Skip the version byte, it comes before the compressed header.
+  const char *data = RSTRING_PTR(str_buffer) + 1;
+  size_t len = RSTRING_LEN(str_buffer) - 1;
 
   if (len > RETF_USIZE_MAX) {
     rb_raise(rb_eArgError,
              "encoded data is too large length must fit in a "
              "32-bit unsigned integer");
-    return Qundef;
   }
 
+  // compressBound holds for every level with the default window and
+  // memory settings, so the output never runs out of room.
+  size_t bound = compressBound(len);
+
+  VALUE out_str = rb_str_buf_new(6 + bound);
+  char *out = RSTRING_PTR(out_str);
+
+  out[0] = (char)131;
+  out[1] = 80;
+
   uint32_t nlen = htobe32(len);
+  memcpy(out + 2, &nlen, 4);
+
+  deflate_call call;
+  memset(&call, 0, sizeof(call));
+
+  if (deflateInit(&call.stream, level) != Z_OK) {
+    rb_raise(rb_eNoMemError, "failed to initialize zlib");
+  }
+
+  call.stream.next_in = (Bytef *)data;
+  call.stream.next_out = (Bytef *)out + 6;
+  call.in_end = data + len;
+  call.out_end = out + 6 + bound;
+
+  retf_stats *stats = retf_stats_get();
+  uint64_t started = stats != NULL ? retf_stats_now() : 0;
+
+  // Both strings are only referenced from here,
+  // so nothing else can touch them meanwhile.
+  int error = retf_run_steps(deflate_step, &call, len >= RETF_NOGVL_ZLIB_MIN);
+
+  int status = call.status;
+  size_t compressed_len = (char *)call.stream.next_out - (out + 6);
+  deflateEnd(&call.stream);
+
+  if (stats != NULL) {
+    retf_stats_count_zlib(&stats->deflate, len, compressed_len, started);
+  }
+
+  RB_GC_GUARD(str_buffer);
+
+  if (RB_UNLIKELY(error != 0)) {
+    rb_jump_tag(error);
+  }
+
+  if (RB_UNLIKELY(status != Z_STREAM_END)) {
+    rb_raise(rb_eRuntimeError, "failed to compress data");
+  }
+
+  rb_str_set_len(out_str, 6 + compressed_len);
+
+  return out_str;
+}
+
+void retf_encode_term(VALUE term, retf_writer *writer, int byte_lists) {
+  encode_with(term, writer, 0, byte_lists, encode_value);
+}
+
+// After a distribution header atoms are written as references
+// into its atom cache where possible. Each of these takes the
+// offset at which the full encoding of an atom (identified by
+// `key`) was just written.
+static inline void refer_to_atom(retf_writer *writer, VALUE key,
+                                 size_t start) {
+  if (RB_UNLIKELY(writer->dist_refs != NULL)) {
+    retf_dist_refer_to_atom(writer, key, start);
+  }
+}
+
+static inline void encode_atom_literal(VALUE key, const char *encoded,
+                                       size_t len, retf_writer *writer) {
+  size_t start = writer->len;
+  retf_writer_put_bytes(writer, encoded, len);
+  refer_to_atom(writer, key, start);
+}
+
+static void check_depth(retf_encoder *enc) {
+  if (RB_UNLIKELY(enc->max_depth != 0 && enc->depth + 1 > enc->max_depth)) {
+    rb_raise(rb_eArgError, "term is nested deeper than max_depth");
+  }
+}
+
+static inline stats_mark stats_begin(retf_encoder *enc) {
+  stats_mark mark = {enc->writer->flushed + enc->writer->len,
+                     enc->stats_nested};
+  enc->stats_nested = 0;
+
+  return mark;
+}
+
+// Counts the term written since `mark` under its tag. Only maps (whose
+// pairs are written along with them) and long strings, bit binaries and
+// integers (which are handed to the IO as they are) can be flushed before
+// they're finished, in which case the tag has to be given as `flushed_tag`
+// instead.
+static void stats_end(retf_encoder *enc, stats_mark mark,
+                      unsigned char flushed_tag) {
+  retf_writer *writer = enc->writer;
+  size_t len = writer->flushed + writer->len - mark.start;
+
+  // Whatever `to_etf` methods wrote has been counted by the calls they made
+  if (!enc->stats_skip) {
+    unsigned char tag = mark.start >= writer->flushed
+                            ? writer->ptr[mark.start - writer->flushed]
+                            : flushed_tag;
+
+    retf_stats_count_tag(&enc->stats->encoded, tag, len - enc->stats_nested);
+  }
+
+  enc->stats_skip = 0;
+  enc->stats_nested = mark.nested + len;
+}
+
+// Counts an atom written straight into the map being
+// written, without going through `encode_value`.
+static inline void stats_atom(retf_encoder *enc, size_t start) {
+  retf_writer *writer = enc->writer;
+  size_t len = writer->flushed + writer->len - start;
+  unsigned char tag =
+      start >= writer->flushed ? writer->ptr[start - writer->flushed] : 119;
+
+  retf_stats_count_tag(&enc->stats->encoded, tag, len);
+  enc->stats_nested += len;
+}
+
+// Pushes a frame for `source`, whose header has already been written.
+static encode_frame *push_frame(retf_encoder *enc, VALUE source) {
+  encode_frame *frames = enc->frames.items;
+
+  if (enc->depth < RETF_CYCLE_SCAN_DEPTH) {
+    for (size_t i = 0; i < enc->depth; i++) {
+      if (RB_UNLIKELY(frames[i].source == source)) {
+        rb_raise(rb_eArgError, "cannot encode a term which contains itself");
+      }
+    }
+  } else {
+    // Deeper down, frames are only compared against the one at the
+    // last power of two deep (as in Brent's cycle detection). A cycle
+    // repeats forever, so it's still caught by the time it has gone
+    // round once past the first power of two at least as long as it.
+    size_t checkpoint = (size_t)1 << (63 - __builtin_clzll(enc->depth));
+
+    if (RB_UNLIKELY(frames[checkpoint - 1].source == source)) {
+      rb_raise(rb_eArgError, "cannot encode a term which contains itself");
+    }
+  }
+
+  if (RB_UNLIKELY(enc->depth == enc->frames.capa)) {
+    retf_stack_grow(&enc->frames, enc->depth, sizeof(encode_frame));
+  }
+
+  encode_frame *frame = (encode_frame *)enc->frames.items + enc->depth++;
+  frame->source = source;
+  frame->elements = Qnil;
+  frame->index = 0;
+  frame->pairs = 0;
+  frame->tail = 0;
+  frame->shape = NULL;
+  frame->shape_buffer = 0;
+
+  return frame;
+}
+
+static void pop_frame(retf_encoder *enc) {
+  encode_frame *frame = (encode_frame *)enc->frames.items + --enc->depth;
+
+  if (frame->shape_buffer != 0) {
+    rb_free_tmp_buffer(&frame->shape_buffer);
+  } else if (frame->shape != NULL && !frame->pairs) {
+    enc->spare_shape = frame->shape;
+  }
+
+  if (frame->pairs) {
+    enc->pair_count = frame->start;
+  }
+}
+
+// Whether `term` may need a frame of its own. Objects other than PIDs,
+// references and bit binaries may well be encoded by `to_etf` instead,
+// which only costs the map they're in copying out its remaining pairs.
+static inline int is_container(VALUE term) {
+  switch (rb_type(term)) {
+    case T_ARRAY:
+      return RARRAY_LEN(term) > 0;
+    case T_HASH:
+      return RHASH_SIZE(term) > 0;
+    case T_OBJECT: {
+      VALUE klass = rb_obj_class(term);
+
+      return klass != retf_constants_get_pid_class() &&
+             klass != retf_constants_get_reference_class() &&
+             klass != retf_constants_get_bitstring_class();
+    }
+    default:
+      return 0;
+  }
+}
+
+// Writes a map key, copying it from the shape when it's the
+// same as the key in the same place of the previous hash.
+static void encode_shaped_key(retf_encoder *enc, retf_shape *shape,
+                              VALUE key) {
+  retf_writer *writer = enc->writer;
+
+  long i = shape->index++;
+  size_t used = i == 0 ? 0 : shape->ends[i - 1];
+
+  if (shape->matching && i < shape->count && shape->keys[i] == key) {
+    size_t copied = writer->flushed + writer->len;
+    retf_writer_put_bytes(writer, shape->bytes + used, shape->ends[i] - used);
+
+    if (RB_UNLIKELY(enc->stats != NULL)) {
+      stats_atom(enc, copied);
+    }
+
+    return;
+  }
+
+  // Counted from the start of the output, as writing to an IO may
+  // flush the buffer. Atoms reserve their space up front so the
+  // key itself always ends up in one piece at the end.
+  size_t start = writer->flushed + writer->len;
+  encode_value(enc, key);
+
+  // The keys up to here are the same as the previous
+  // hash's, so this one takes over the rest of the shape.
+  if (shape->matching) {
+    size_t len = writer->flushed + writer->len - start;
+    shape->count = i;
+
+    if (RB_TYPE_P(key, T_SYMBOL) && i < RETF_SHAPE_MAX_KEYS &&
+        len <= RETF_SHAPE_MAX_BYTES - used) {
+      memcpy(shape->bytes + used, writer->ptr + writer->len - len, len);
+      shape->keys[i] = key;
+      shape->ends[i] = used + len;
+      shape->count = i + 1;
+    } else {
+      shape->matching = 0;
+    }
+  }
+}
+
+static inline void encode_key(retf_encoder *enc, retf_shape *shape,
+                              VALUE key) {
+  if (shape == NULL) {
+    encode_value(enc, key);
+  } else {
+    encode_shaped_key(enc, shape, key);
+  }
+}
+
+typedef struct {
+  retf_encoder *enc;
+  retf_shape *shape;
+
+  // Set once a pair which may need a frame of its own comes up,
+  // it and every pair after it then go onto the pair stack.
+  int nested;
+} map_iteration;
+
+static inline void push_pair_value(retf_encoder *enc, VALUE value) {
+  if (RB_UNLIKELY(enc->pair_count == enc->pairs.capa)) {
+    retf_stack_grow(&enc->pairs, enc->pair_count, sizeof(VALUE));
+  }
+
+  ((VALUE *)enc->pairs.items)[enc->pair_count++] = value;
+}
+
+static int encode_hash_pair(VALUE key, VALUE value, VALUE arg) {
+  map_iteration *iteration = (map_iteration *)arg;
+
+  if (RB_LIKELY(!iteration->nested)) {
+    if (RB_LIKELY(!is_container(key) && !is_container(value))) {
+      encode_key(iteration->enc, iteration->shape, key);
+      encode_value(iteration->enc, value);
+      return ST_CONTINUE;
+    }
+
+    iteration->nested = 1;
+  }
+
+  push_pair_value(iteration->enc, key);
+  push_pair_value(iteration->enc, value);
+  return ST_CONTINUE;
+}
+
+// Writes out the pairs of `hash`, leaving a frame for
+// `source` to finish them off if some are nested.
+static void encode_pairs(retf_encoder *enc, VALUE source, VALUE hash,
+                         retf_shape *shape) {
+  if (shape != NULL) {
+    shape->index = 0;
+    shape->matching = 1;
+  }
+
+  size_t start = enc->pair_count;
+
+  map_iteration iteration = {enc, shape, 0};
+  rb_hash_foreach(hash, encode_hash_pair, (VALUE)&iteration);
+
+  if (iteration.nested) {
+    encode_frame *frame = push_frame(enc, source);
+    frame->start = start;
+    frame->len = enc->pair_count - start;
+    frame->pairs = 1;
+    frame->shape = shape;
+  }
+}
+
+// Like rb_ary_entry, `to_etf` methods may have shrunk the array
+static inline VALUE element_at(VALUE elements, long i) {
+  return i < RARRAY_LEN(elements) ? RARRAY_AREF(elements, i) : Qnil;
+}
+
+// Encodes the elements of the innermost frame until
+// one needs a frame of its own, and so on until every
+// frame has been finished. The frame being worked on
+// can only move when another one is pushed.
+static void encode_elements(retf_encoder *enc) {
+  while (enc->depth > 0) {
+    size_t depth = enc->depth;
+    encode_frame *frame = (encode_frame *)enc->frames.items + depth - 1;
+    long i = frame->index;
+
+    if (i == frame->len) {
+      if (frame->tail != 0) {
+        retf_writer_put_byte(enc->writer, frame->tail);
+
+        if (RB_UNLIKELY(enc->stats != NULL)) {
+          retf_stats_count_tag(&enc->stats->encoded, frame->tail, 1);
+        }
+      }
+
+      pop_frame(enc);
+      continue;
+    }
+
+    retf_shape *shape = frame->shape;
+
+    if (frame->pairs) {
+      do {
+        VALUE elem = ((VALUE *)enc->pairs.items)[frame->start + i];
+        frame->index = ++i;
+
+        if (i % 2 == 1) {
+          encode_key(enc, shape, elem);
+        } else {
+          encode_value(enc, elem);
+        }
+      } while (enc->depth == depth && i < frame->len);
+    } else if (shape != NULL) {
+      do {
+        VALUE elem = element_at(frame->elements, i);
+        frame->index = ++i;
+
+        if (RB_TYPE_P(elem, T_HASH)) {
+          encode_shaped_map(enc, elem, shape);
+        } else {
+          encode_value(enc, elem);
+        }
+      } while (enc->depth == depth && i < frame->len);
+    } else {
+      do {
+        VALUE elem = element_at(frame->elements, i);
+        frame->index = ++i;
+
+        encode_value(enc, elem);
+      } while (enc->depth == depth && i < frame->len);
+    }
+  }
+}
+
+static inline void encode_counted(VALUE term, retf_writer *writer,
+                                  size_t max_depth, int byte_lists,
+                                  void (*begin)(retf_encoder *enc, VALUE term),
+                                  retf_stats *stats) {
+  encode_frame frame_storage[RETF_ENCODE_INLINE_FRAMES];
+  VALUE pair_storage[RETF_ENCODE_INLINE_PAIRS];
+  retf_shape shape_storage;
+
+  retf_encoder enc;
+  enc.writer = writer;
+  enc.depth = 0;
+  enc.pair_count = 0;
+  enc.max_depth = max_depth;
+  enc.byte_lists = byte_lists;
+  enc.spare_shape = &shape_storage;
+  enc.stats = stats;
+  enc.stats_nested = 0;
+  enc.stats_skip = 0;
+  retf_stack_init(&enc.frames, frame_storage, RETF_ENCODE_INLINE_FRAMES);
+  retf_stack_init(&enc.pairs, pair_storage, RETF_ENCODE_INLINE_PAIRS);
+
+  // `encode_value` counts the terms it writes itself
+  if (RB_UNLIKELY(enc.stats != NULL) && begin != encode_value) {
+    stats_mark mark = stats_begin(&enc);
+    begin(&enc, term);
+    stats_end(&enc, mark, 116);
+  } else {
+    begin(&enc, term);
+  }
+
+  if (enc.depth > 0) {
+    encode_elements(&enc);
+  }
 
-  // compress the data
-  VALUE zipped_str = rb_funcall(retf_constants_get_zlib_deflate(),
-                                rb_intern("deflate"), 1, str_buffer);
+  retf_stack_free(&enc.frames);
+  retf_stack_free(&enc.pairs);
+}
+
+static inline void encode_with(VALUE term, retf_writer *writer,
+                               size_t max_depth, int byte_lists,
+                               void (*begin)(retf_encoder *enc, VALUE term)) {
+  encode_counted(term, writer, max_depth, byte_lists, begin, retf_stats_get());
+}
 
-  VALUE out_str = rb_str_buf_new(6 + RSTRING_LEN(zipped_str));
-  rb_str_cat(out_str, "\x83\x50", 2);
-  rb_str_cat(out_str, (char *)&nlen, 4);
-  return rb_str_concat(out_str, zipped_str);
+// The node of a PID or reference is counted as part of it,
+// the same as when it's decoded.
+static void encode_node(VALUE self, retf_writer *writer) {
+  VALUE node = rb_ivar_get(self, retf_constants_get_node_ivar());
+
+  encode_counted(node, writer, 0, 0, encode_value, NULL);
 }
 
-static VALUE encode_term(VALUE term, VALUE str_buffer) {
+static inline void write_value(retf_encoder *enc, VALUE term) {
+  retf_writer *writer = enc->writer;
   int t = TYPE(term);
 
   switch (t) {
     case T_NIL:
-      return rb_str_cat(str_buffer, "w\003nil", 5);
+      encode_atom_literal(term, "w\003nil", 5, writer);
+      break;
     case T_TRUE:
-      return rb_str_cat(str_buffer, "w\004true", 6);
+      encode_atom_literal(term, "w\004true", 6, writer);
+      break;
     case T_FALSE:
-      return rb_str_cat(str_buffer, "w\005false", 7);
+      encode_atom_literal(term, "w\005false", 7, writer);
+      break;
     case T_FIXNUM:
-      return encode_fixed_integer(FIX2LONG(term), str_buffer);
+      encode_fixed_integer(FIX2LONG(term), writer);
+      break;
     case T_BIGNUM:
-      return encode_big_integer(term, str_buffer);
+      encode_big_integer(term, writer);
+      break;
     case T_FLOAT:
-      return encode_float(term, str_buffer);
+      encode_float(term, writer);
+      break;
     case T_STRING:
-      return encode_string(term, str_buffer);
+      encode_string(term, writer);
+      break;
     case T_ARRAY:
-      return encode_array(term, str_buffer);
+      encode_array(enc, term);
+      break;
     case T_HASH:
-      return encode_map(term, str_buffer);
+      encode_map(enc, term, NULL);
+      break;
     case T_SYMBOL:
-      return encode_atom(term, str_buffer);
+      encode_atom(term, writer);
+      break;
     case T_CLASS:
     case T_MODULE:
-      return encode_class(term, str_buffer);
-    case T_OBJECT:
-      return encode_object(term, str_buffer);
+      encode_class(term, writer);
+      break;
+    case T_OBJECT: {
+      // Subclasses may have their own `to_etf`
+      VALUE klass = rb_obj_class(term);
+
+      if (klass == retf_constants_get_tuple_class()) {
+        encode_tuple(enc, term);
+      } else if (klass == retf_constants_get_pid_class()) {
+        encode_pid(term, writer);
+      } else if (klass == retf_constants_get_reference_class()) {
+        encode_reference(term, writer);
+      } else if (klass == retf_constants_get_bitstring_class()) {
+        encode_bit_binary(term, writer);
+      } else {
+        encode_object(enc, term);
+      }
+      break;
+    }
+    case T_DATA:
+      // Only terms encoded ahead of time with Retf.preencode
+      if (!retf_encoded_p(term)) {
+        rb_raise(rb_eArgError, "unsupported type for encoding");
+      }
+
+      retf_encoded_write(term, writer);
+      break;
     default:
       rb_raise(rb_eArgError, "unsupported type for encoding");
   }
+}
+
+// The tag of a term which may have been flushed to the IO before
+// it was finished, see `stats_end`.
+static unsigned char flushed_tag(VALUE term) {
+  switch (rb_type(term)) {
+    case T_STRING:
+      return 109;
+    case T_BIGNUM:
+      return 111;
+    case T_OBJECT:
+      if (rb_obj_class(term) == retf_constants_get_bitstring_class()) {
+        return 77;
+      }
+      return 116;
+    default:
+      return 116;
+  }
+}
+
+static void encode_counted_value(retf_encoder *enc, VALUE term) {
+  stats_mark mark = stats_begin(enc);
+  write_value(enc, term);
+  stats_end(enc, mark, flushed_tag(term));
+}
+
+// Writes `term` if it's a leaf, or the header of a map,
+// list or tuple and a frame for the rest of it.
+static void encode_value(retf_encoder *enc, VALUE term) {
+  if (RB_UNLIKELY(enc->stats != NULL)) {
+    encode_counted_value(enc, term);
+    return;
+  }
 
-  return Qundef;
+  write_value(enc, term);
 }
 
 VALUE retf_encode_integer(int argc, VALUE *argv, VALUE self) {
   return scan_and_call(argc, argv, self, encode_any_integer);
 }
 
-static VALUE encode_any_integer(VALUE self, VALUE str_buffer) {
+static void encode_any_integer(VALUE self, retf_writer *writer) {
   if (TYPE(self) == T_FIXNUM) {
-    return encode_fixed_integer(FIX2LONG(self), str_buffer);
+    encode_fixed_integer(FIX2LONG(self), writer);
+    return;
   }
 
-  return encode_big_integer(self, str_buffer);
+  encode_big_integer(self, writer);
 }
 
-static VALUE encode_big_integer(VALUE bigint, VALUE str_buffer) {
-  // large integer encoding... yaayyyy
+static void encode_big_integer(VALUE bigint, retf_writer *writer) {
   char sign = rb_big_sign(bigint) == 0 ? 1 : 0;
 
-  if (sign == 1) {
-    bigint = rb_funcall(bigint, rb_intern("abs"), 0);
-  }
-
-  // going with a length of 11 bytes
-  // since we likely won't be encoding
-  // anything larger than that for the
-  // most part.
-  VALUE str = rb_str_buf_new(11);
+  // The magnitude is written least significant byte first,
+  // which rb_integer_pack can do in a single pass.
+  size_t len = rb_absint_size(bigint, NULL);
 
-  long len = 0;
+  if (RB_UNLIKELY(len > UINT32_MAX)) {
+    rb_raise(rb_eRangeError, "integer is too large to encode");
+  }
 
-  while (!RTEST(RETF_BIG_EQ(bigint, INT2FIX(0)))) {
-    if (RB_TYPE_P(bigint, T_FIXNUM)) {
-      break;
-    }
+  // Writing to an IO, large magnitudes are packed into a string
+  // of their own and handed over alongside the buffer.
+  int direct = !NIL_P(writer->io) && len >= RETF_WRITER_IO_DIRECT_MIN;
 
-    char byte = FIX2INT(RETF_BIG_AND(bigint, INT2FIX(0xFF)));
-    bigint = RETF_BIG_RSHIFT(bigint, INT2FIX(8));
+  retf_writer_reserve(writer, 6 + (direct ? 0 : len));
 
-    rb_str_cat(str, &byte, 1);
-    len++;
+  if (len < 256) {
+    retf_writer_put_byte(writer, 110);
+    retf_writer_put_byte(writer, len);
+  } else {
+    retf_writer_put_byte(writer, 111);
+    retf_writer_put_be32(writer, len);
   }
 
-  // At some point rb_big_rshift may return a fixnum
-  // so we need to handle that case as well.
-  if(RB_TYPE_P(bigint, T_FIXNUM)) {
-    long long bigint_val = FIX2LONG(bigint);
+  retf_writer_put_byte(writer, sign);
 
-    while (bigint_val > 0) {
-      char byte = bigint_val & 0xFF;
-      bigint_val >>= 8;
+  if (direct) {
+    VALUE magnitude = rb_str_buf_new(len);
+    rb_integer_pack(bigint, RSTRING_PTR(magnitude), len, 1, 0,
+                    INTEGER_PACK_LITTLE_ENDIAN);
+    rb_str_set_len(magnitude, len);
 
-      rb_str_cat(str, &byte, 1);
-      len++;
-    }
+    retf_writer_write_io(writer, magnitude);
+    return;
   }
 
-  if(len < 256) {
-    unsigned char new_len = len;
-    rb_str_cat(str_buffer, "\x6E", 1);
-    rb_str_cat(str_buffer, (char *)&new_len, 1);
-  } else {
-    uint32_t new_len = htobe32(len);
-    rb_str_cat(str_buffer, "\x6F", 1);
-    rb_str_cat(str_buffer, (char *)&new_len, 4);
-  }
-
-  rb_str_cat(str_buffer, &sign, 1);
-  return rb_str_concat(str_buffer, str);
+  rb_integer_pack(bigint, writer->ptr + writer->len, len, 1, 0,
+                  INTEGER_PACK_LITTLE_ENDIAN);
+  writer->len += len;
 }
 
-static VALUE encode_fixed_integer(long val, VALUE str_buffer) {
+static void encode_fixed_integer(long val, retf_writer *writer) {
   if (val >= 0 && val < 256) {
-    rb_str_cat(str_buffer, "\x61", 1);
-    return rb_str_cat(str_buffer, (char *)&val, 1);
+    unsigned char small_int[2] = {97, val};
+    retf_writer_put_bytes(writer, small_int, 2);
+    return;
   }
 
   if (val >= RETF_ISIZE_MIN && val <= RETF_ISIZE_MAX) {
-    rb_str_cat(str_buffer, "\x62", 1);
-
-    int32_t nval = htobe32(val);
-
-    return rb_str_cat(str_buffer, (char *)&nval, 4);
+    retf_writer_reserve(writer, 5);
+    retf_writer_put_byte(writer, 98);
+    retf_writer_put_be32(writer, (uint32_t)(int32_t)val);
+    return;
   }
 
   // large integer encoding... yaayyyy
   char sign = val < 0 ? 1 : 0;
 
-  long abs_val = labs(val);
+  // Fixnums are narrower than a long, so this can't overflow
+  unsigned long abs_val = val < 0 ? -(unsigned long)val : (unsigned long)val;
+
+  char bytes = 0;
 
-  // Instead of shifting the bits to find the number of bytes
-  // we can just use log2 to find the number of bits
-  // and then divide by 8 to get the number of bytes
-  // rounding up.
-  long count = (long) ceil(log2(abs_val));
-  char bytes = count / 8 + (count % 8 == 0 ? 0 : 1);
+  while (bytes < 8 && (abs_val >> (bytes * 8)) != 0) {
+    bytes++;
+  }
 
   // Since the bytes go least significant first
   // we need to convert the number to little endian.
   uint64_t encoded = htole64(abs_val);
 
-  rb_str_cat(str_buffer, "\x6E", 1);
-  rb_str_cat(str_buffer, &bytes, 1);
-  rb_str_cat(str_buffer, &sign, 1);
+  retf_writer_reserve(writer, 3 + bytes);
+  retf_writer_put_byte(writer, 110);
+  retf_writer_put_byte(writer, bytes);
+  retf_writer_put_byte(writer, sign);
 
   // Only write the bytes we need rather than the full 8
-  return rb_str_cat(str_buffer, (char *)&encoded, bytes);
+  retf_writer_put_bytes(writer, &encoded, bytes);
 }
 
 VALUE retf_encode_float(int argc, VALUE *argv, VALUE self) {
   return scan_and_call(argc, argv, self, encode_float);
 }
 
-static VALUE encode_float(VALUE self, VALUE str_buffer) {
+static void encode_float(VALUE self, retf_writer *writer) {
   double to_encode = rb_float_value(self);
 
   if (!isfinite(to_encode)) {
     rb_raise(rb_eArgError, "only floats with a finite value can be encoded");
-    return Qundef;
   }
 
-  rb_str_cat(str_buffer, "\x46", 1);
-
   uint64_t num;
   memcpy(&num, &to_encode, 8);
-  num = htobe64(num);
 
-  return rb_str_cat(str_buffer, (char *)&num, 8);
+  retf_writer_reserve(writer, 9);
+  retf_writer_put_byte(writer, 70);
+  retf_writer_put_be64(writer, num);
 }
 
 VALUE retf_encode_string(int argc, VALUE *argv, VALUE self) {
   return scan_and_call(argc, argv, self, encode_string);
 }
 
-static VALUE encode_string(VALUE self, VALUE str_buffer) {
+static void encode_string(VALUE self, retf_writer *writer) {
   size_t len = RSTRING_LEN(self);
 
   if (len > RETF_USIZE_MAX) {
     rb_raise(rb_eArgError,
              "string is too long to encode, bytesize must "
              "fit in a 32-bit unsigned integer");
-    return Qundef;
   }
 
-  ensure_str_extra_capacity(str_buffer, 5 + len);
+  if (!NIL_P(writer->io) && len >= RETF_WRITER_IO_DIRECT_MIN) {
+    retf_writer_reserve(writer, 5);
+    retf_writer_put_byte(writer, 109);
+    retf_writer_put_be32(writer, len);
+    retf_writer_write_io(writer, self);
+    return;
+  }
 
-  uint32_t nlen = htobe32(len);
+  retf_writer_reserve(writer, 5 + len);
+  retf_writer_put_byte(writer, 109);
+  retf_writer_put_be32(writer, len);
+
+  if (RB_LIKELY(len < RETF_NOGVL_COPY_MIN)) {
+    retf_writer_put_bytes(writer, RSTRING_PTR(self), len);
+    return;
+  }
 
-  rb_str_cat(str_buffer, "\x6D", 1);
-  rb_str_cat(str_buffer, (char *)&nlen, 4);
-  return rb_str_cat(str_buffer, RSTRING_PTR(self), len);
+  // The buffer may have been handed to Ruby code by a `to_etf` method,
+  // lock it so that no other thread can resize it while it's copied to.
+  rb_str_locktmp(writer->str);
+
+  int error = retf_copy_bytes(writer->ptr + writer->len, self,
+                              RSTRING_PTR(self), len);
+
+  rb_str_unlocktmp(writer->str);
+
+  if (RB_UNLIKELY(error != 0)) {
+    rb_jump_tag(error);
+  }
+
+  writer->len += len;
 }
 
 VALUE retf_encode_array(int argc, VALUE *argv, VALUE self) {
-  return scan_and_call(argc, argv, self, encode_array);
+  return scan_and_encode(argc, argv, self, encode_array);
 }
 
-static VALUE encode_array(VALUE self, VALUE str_buffer) {
+// Fixnums are tagged as `(n << 1) | 1`, so 0 to 255 are exactly
+// the values with the low bit set and nothing above bit 8.
+#define RETF_BYTE_FIXNUM_MASK (~(VALUE)0x1FE)
+
+// Whether every element is an Integer between 0 and 255. The elements
+// are checked a block at a time without branching, which compilers
+// turn into vector instructions, and the first element on its own so
+// that lists of anything else bail out straight away.
+static int is_byte_list(const VALUE *elements, long len) {
+  if ((elements[0] & RETF_BYTE_FIXNUM_MASK) != RUBY_FIXNUM_FLAG) {
+    return 0;
+  }
+
+  for (long i = 0; i < len; i += 32) {
+    long end = len - i < 32 ? len : i + 32;
+    VALUE invalid = 0;
+
+    for (long j = i; j < end; j++) {
+      invalid |= (elements[j] & RETF_BYTE_FIXNUM_MASK) ^ RUBY_FIXNUM_FLAG;
+    }
+
+    if (invalid != 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Writes a list of bytes as STRING_EXT, a byte per element
+// rather than the 2 a SMALL_INTEGER_EXT in a list takes.
+static void encode_byte_list(const VALUE *elements, long len,
+                             retf_writer *writer) {
+  retf_writer_reserve(writer, 3);
+  retf_writer_put_byte(writer, 107);
+  retf_writer_put_be16(writer, len);
+
+  // Reserved apart from the header, so that it
+  // always fits in the buffer of `encode_to`.
+  retf_writer_reserve(writer, len);
+
+  unsigned char *bytes = (unsigned char *)writer->ptr + writer->len;
+
+  for (long i = 0; i < len; i++) {
+    bytes[i] = (unsigned char)(elements[i] >> 1);
+  }
+
+  writer->len += len;
+}
+
+static void encode_array(retf_encoder *enc, VALUE self) {
+  retf_writer *writer = enc->writer;
   long len = rb_array_len(self);
 
   if (RB_UNLIKELY(len > RETF_USIZE_MAX)) {
     rb_raise(rb_eArgError,
              "array is too long to encode, length must fit "
              "in a 32-bit unsigned integer");
-    return Qundef;
   }
 
   if (len == 0) {
     // Empty list code
-    return rb_str_cat(str_buffer, "\x6A", 1);
+    retf_writer_put_byte(writer, 106);
+    return;
   }
 
-  ensure_str_extra_capacity(str_buffer, 5 + len);
+  check_depth(enc);
 
-  // 108 is the list tag
-  rb_str_cat(str_buffer, "\x6C", 1);
+  // STRING_EXT has a 16 bit length
+  if (enc->byte_lists && len <= UINT16_MAX) {
+    const VALUE *elements = RARRAY_CONST_PTR(self);
 
-  uint32_t nlen = htobe32(len);
+    if (is_byte_list(elements, len)) {
+      encode_byte_list(elements, len, writer);
+      RB_GC_GUARD(self);
+      return;
+    }
+  }
 
-  rb_str_cat(str_buffer, (char *)&nlen, 4);
+  // Every element takes at least 2 bytes, so reserve
+  // that much up front along with the header and tail.
+  retf_writer_reserve_hint(writer, 6 + (len * 2));
 
-  for (long i = 0; i < len; i++) {
-    VALUE elem = rb_ary_entry(self, i);
-    encode_term(elem, str_buffer);
-  }
+  // 108 is the list tag
+  retf_writer_put_byte(writer, 108);
+  retf_writer_put_be32(writer, len);
+
+  encode_frame *frame = push_frame(enc, self);
+  frame->elements = self;
+  frame->len = len;
 
   // 106 is the empty list tag
   // properly formatted lists should end with an empty list
-  return rb_str_cat(str_buffer, "\x6A", 1);
+  frame->tail = 106;
+
+  if (len > 1 && RB_TYPE_P(rb_ary_entry(self, 0), T_HASH)) {
+    if (enc->spare_shape != NULL) {
+      frame->shape = enc->spare_shape;
+      enc->spare_shape = NULL;
+    } else {
+      frame->shape =
+          rb_alloc_tmp_buffer(&frame->shape_buffer, sizeof(retf_shape));
+    }
+
+    frame->shape->count = 0;
+  }
 }
 
 VALUE retf_encode_map(int argc, VALUE *argv, VALUE self) {
-  return scan_and_call(argc, argv, self, encode_map);
+  return scan_and_encode(argc, argv, self, encode_root_map);
 }
 
-static VALUE encode_map(VALUE self, VALUE str_buffer) {
+static void encode_map_header(VALUE self, retf_writer *writer) {
   size_t size = RHASH_SIZE(self);
 
   if (RB_UNLIKELY(size > RETF_USIZE_MAX)) {
     rb_raise(rb_eArgError,
              "map is too large to encode, size must fit in a "
              "32-bit unsigned integer");
-    return Qundef;
   }
 
-  ensure_str_extra_capacity(str_buffer, 5 + (size * 2));
+  // Every key and value takes at least 2 bytes.
+  retf_writer_reserve_hint(writer, 5 + (size * 4));
 
   // 116 is the map tag
-  rb_str_cat(str_buffer, "\x74", 1);
+  retf_writer_put_byte(writer, 116);
+  retf_writer_put_be32(writer, size);
+}
 
-  uint32_t nsize = htobe32(size);
+// `shape` is that of the list of hashes the map is in, if any
+static void encode_map(retf_encoder *enc, VALUE self, retf_shape *shape) {
+  check_depth(enc);
+  encode_map_header(self, enc->writer);
+  encode_pairs(enc, self, self, shape);
+}
 
-  rb_str_cat(str_buffer, (char *)&nsize, 4);
+static void encode_root_map(retf_encoder *enc, VALUE self) {
+  encode_map(enc, self, NULL);
+}
 
-  rb_hash_foreach(self, encode_hash_pair, str_buffer);
+// The hashes in a list of hashes skip `encode_value`
+static void encode_shaped_map(retf_encoder *enc, VALUE self,
+                              retf_shape *shape) {
+  if (RB_LIKELY(enc->stats == NULL)) {
+    encode_map(enc, self, shape);
+    return;
+  }
 
-  return str_buffer;
+  stats_mark mark = stats_begin(enc);
+  encode_map(enc, self, shape);
+  stats_end(enc, mark, 116);
 }
 
-static int encode_hash_pair(VALUE key, VALUE value, VALUE buffer) {  
-  encode_term(key, buffer);
-  encode_term(value, buffer);
-  return ST_CONTINUE;
-}
+static void encode_object(retf_encoder *enc, VALUE self) {
+  retf_writer *writer = enc->writer;
 
-static VALUE encode_object(VALUE self, VALUE str_buffer) {
   // For classes which don't encode to Elixir Struct-like
   // maps, they can instead implement `to_etf`
   // which will be called to encode the object.
   VALUE to_etf_sym = retf_constants_get_to_etf();
   if (rb_respond_to(self, to_etf_sym)) {
-    return rb_funcall(self, to_etf_sym, 1, str_buffer);
+    // The Ruby code appends to the same string
+    // so it needs to see everything written so far.
+    retf_writer_flush_len(writer);
+    rb_funcall(self, to_etf_sym, 1, writer->str);
+    retf_writer_sync(writer);
+    enc->stats_skip = 1;
+    return;
   }
 
   VALUE as_etf_sym = retf_constants_get_as_etf();
 
   if (!rb_respond_to(self, as_etf_sym)) {
     rb_raise(rb_eArgError, "object does not respond to `as_etf`");
-    return Qundef;
   }
 
+  check_depth(enc);
+
   VALUE hash_to_encode = rb_funcall(self, as_etf_sym, 0);
 
+  if (RB_UNLIKELY(enc->stats != NULL)) {
+    enc->stats->as_etf++;
+  }
+
   Check_Type(hash_to_encode, T_HASH);
 
   // We're duplicating the code for encoding a map here
@@ -366,33 +1197,179 @@ static VALUE encode_object(VALUE self, VALUE str_buffer) {
     rb_raise(rb_eArgError,
              "map is too large to encode, size must fit in a "
              "32-bit unsigned integer");
-    return Qundef;
   }
 
-  ensure_str_extra_capacity(str_buffer, 5 + (size * 2));
+  retf_writer_reserve_hint(writer, 17 + (size * 4));
 
   // 116 is the map tag
-  rb_str_cat(str_buffer, "\x74", 1);
-
-  uint32_t nsize = htobe32(size);
+  retf_writer_put_byte(writer, 116);
+  retf_writer_put_be32(writer, size);
 
-  rb_str_cat(str_buffer, (char *)&nsize, 4);
+  size_t start = writer->flushed + writer->len;
+  encode_atom_literal(rb_id2sym(retf_constants_get_struct()),
+                      "\x77\x0A__struct__", 12, writer);
 
-  rb_str_cat(str_buffer, "\x77\x0A__struct__", 12);
+  if (RB_UNLIKELY(enc->stats != NULL)) {
+    stats_atom(enc, start);
+    start = writer->flushed + writer->len;
+  }
 
   VALUE class = rb_obj_class(self);
-  encode_class(class, str_buffer);
+  encode_class(class, writer);
+
+  if (RB_UNLIKELY(enc->stats != NULL)) {
+    stats_atom(enc, start);
+  }
+
+  // `as_etf` returns a new hash every time, so it's the
+  // object which can't be found inside itself.
+  encode_pairs(enc, self, hash_to_encode, NULL);
+}
+
+VALUE retf_encode_tuple(int argc, VALUE *argv, VALUE self) {
+  return scan_and_encode(argc, argv, self, encode_tuple);
+}
+
+static void encode_tuple(retf_encoder *enc, VALUE self) {
+  retf_writer *writer = enc->writer;
+  VALUE elements = rb_ivar_get(self, retf_constants_get_value_ivar());
+
+  Check_Type(elements, T_ARRAY);
+
+  long size = RARRAY_LEN(elements);
+
+  if (RB_UNLIKELY(size > RETF_USIZE_MAX)) {
+    rb_raise(rb_eArgError, "size of tuple exceeds 4 byte integer limit");
+  }
+
+  check_depth(enc);
+
+  if (size < 256) {
+    unsigned char header[2] = {104, size};
+    retf_writer_put_bytes(writer, header, 2);
+  } else {
+    retf_writer_reserve(writer, 5);
+    retf_writer_put_byte(writer, 105);
+    retf_writer_put_be32(writer, size);
+  }
+
+  if (size == 0) {
+    return;
+  }
+
+  encode_frame *frame = push_frame(enc, self);
+  frame->elements = elements;
+  frame->len = size;
+}
+
+// Like `Array#pack('N')`, values which don't
+// fit in 32 bits are truncated.
+static inline uint32_t ivar_uint32(VALUE self, VALUE ivar) {
+  return (uint32_t)NUM2ULL(rb_ivar_get(self, ivar));
+}
+
+VALUE retf_encode_pid(int argc, VALUE *argv, VALUE self) {
+  return scan_and_call(argc, argv, self, encode_pid);
+}
+
+static void encode_pid(VALUE self, retf_writer *writer) {
+  retf_writer_put_byte(writer, 88);
+  encode_node(self, writer);
+
+  retf_writer_reserve(writer, 12);
+  retf_writer_put_be32(writer, ivar_uint32(self, retf_constants_get_id_ivar()));
+  retf_writer_put_be32(writer,
+                       ivar_uint32(self, retf_constants_get_serial_ivar()));
+  retf_writer_put_be32(writer,
+                       ivar_uint32(self, retf_constants_get_creation_ivar()));
+}
+
+VALUE retf_encode_reference(int argc, VALUE *argv, VALUE self) {
+  return scan_and_call(argc, argv, self, encode_reference);
+}
 
-  rb_hash_foreach(hash_to_encode, encode_hash_pair, str_buffer);
+static void encode_reference(VALUE self, retf_writer *writer) {
+  VALUE id = rb_ivar_get(self, retf_constants_get_id_ivar());
 
-  return str_buffer;
+  Check_Type(id, T_ARRAY);
+
+  long size = RARRAY_LEN(id);
+
+  if (RB_UNLIKELY(size > UINT16_MAX)) {
+    rb_raise(rb_eArgError, "reference id is too long to encode");
+  }
+
+  retf_writer_reserve(writer, 3);
+  retf_writer_put_byte(writer, 90);
+  retf_writer_put_be16(writer, size);
+
+  encode_node(self, writer);
+
+  retf_writer_reserve_hint(writer, 4 + (size * 4));
+  retf_writer_put_be32(writer,
+                       ivar_uint32(self, retf_constants_get_creation_ivar()));
+
+  for (long i = 0; i < size; i++) {
+    retf_writer_put_be32(writer, (uint32_t)NUM2ULL(RARRAY_AREF(id, i)));
+  }
+}
+
+VALUE retf_encode_bit_binary(int argc, VALUE *argv, VALUE self) {
+  return scan_and_call(argc, argv, self, encode_bit_binary);
+}
+
+static void encode_bit_binary(VALUE self, retf_writer *writer) {
+  VALUE binary = rb_ivar_get(self, retf_constants_get_binary_ivar());
+  VALUE bits_size = rb_ivar_get(self, retf_constants_get_bits_size_ivar());
+
+  Check_Type(binary, T_STRING);
+
+  size_t len = RSTRING_LEN(binary);
+
+  if (RB_UNLIKELY(len > RETF_USIZE_MAX)) {
+    rb_raise(rb_eArgError,
+             "bit binary is too long to encode, bytesize must "
+             "fit in a 32-bit unsigned integer");
+  }
+
+  unsigned char bits = (unsigned char)NUM2UINT(bits_size);
+
+  retf_writer_reserve_hint(writer, 6 + len);
+  retf_writer_put_byte(writer, 77);
+  retf_writer_put_be32(writer, len);
+  retf_writer_put_byte(writer, bits);
+
+  // Like strings, large ones are handed to the IO as they are
+  if (!NIL_P(writer->io) && len >= RETF_WRITER_IO_DIRECT_MIN) {
+    retf_writer_write_io(writer, binary);
+    return;
+  }
+
+  retf_writer_put_bytes(writer, RSTRING_PTR(binary), len);
 }
 
 VALUE retf_encode_atom(int argc, VALUE *argv, VALUE self) {
   return scan_and_call(argc, argv, self, encode_atom);
 }
 
-static VALUE encode_atom(VALUE self, VALUE str_buffer) {
+// Writes the cached encoding of a Symbol or Class if there is one.
+static inline int encode_cached_atom(VALUE self, retf_writer *writer) {
+  size_t cached_len;
+  const char *cached = retf_atom_cache_encoded(self, &cached_len);
+
+  if (cached == NULL) {
+    return 0;
+  }
+
+  encode_atom_literal(self, cached, cached_len, writer);
+  return 1;
+}
+
+static void encode_atom(VALUE self, retf_writer *writer) {
+  if (encode_cached_atom(self, writer)) {
+    return;
+  }
+
   VALUE str = rb_sym2str(self);
   size_t len = RSTRING_LEN(str);
   char *ptr = RSTRING_PTR(str);
@@ -401,39 +1378,42 @@ static VALUE encode_atom(VALUE self, VALUE str_buffer) {
     rb_raise(rb_eArgError,
              "atom is too long to encode, length must fit in "
              "a 32-bit unsigned integer");
-    return Qundef;
   }
 
   // This may seen a bit weird, but that's because atoms can be
   // utf-8 encoded and this is the length in bytes.
   // The check above was the length in characters.
   if (len < 256) {
-    char new_len = len;
-    ensure_str_extra_capacity(str_buffer, 2 + len);
-    rb_str_cat(str_buffer, "\x77", 1);
-    rb_str_cat(str_buffer, (char *)&new_len, 1);
-    return rb_str_cat(str_buffer, ptr, len);
+    retf_writer_reserve(writer, 2 + len);
+    retf_writer_put_byte(writer, 119);
+    retf_writer_put_byte(writer, len);
   } else {
-    ensure_str_extra_capacity(str_buffer, 3 + len);
-    rb_str_cat(str_buffer, "\x76", 1);
+    retf_writer_reserve(writer, 3 + len);
+    retf_writer_put_byte(writer, 118);
+    retf_writer_put_be16(writer, len);
+  }
 
-    uint16_t nlen = htobe16(len);
+  retf_writer_put_bytes(writer, ptr, len);
 
-    rb_str_cat(str_buffer, (char *)&nlen, 2);
-    return rb_str_cat(str_buffer, ptr, len);
-  }
+  size_t encoded_len = (len < 256 ? 2 : 3) + len;
+  retf_atom_cache_store_encoded(
+      self, writer->ptr + writer->len - encoded_len, encoded_len);
+  refer_to_atom(writer, self, writer->len - encoded_len);
 }
 
 VALUE retf_encode_class(int argc, VALUE *argv, VALUE self) {
   return scan_and_call(argc, argv, self, encode_class);
 }
 
-static VALUE encode_class(VALUE self, VALUE str_buffer) {
+static void encode_class(VALUE self, retf_writer *writer) {
+  if (encode_cached_atom(self, writer)) {
+    return;
+  }
+
   VALUE name = RETF_MOD_NAME(self);
 
   if (RB_NIL_P(name)) {
     rb_raise(rb_eArgError, "cannot encode an anonymous class");
-    return Qundef;
   }
 
   // Replace the double colon with a period
@@ -447,27 +1427,29 @@ static VALUE encode_class(VALUE self, VALUE str_buffer) {
     rb_raise(rb_eArgError,
              "class name is too long to encode, must be no "
              "greater than 255 characters");
-    return Qundef;
   }
 
   // 7 is the length of "Elixir."
   size_t len = RSTRING_LEN(elixirized) + 7;
 
   if (len < 256) {
-    unsigned char new_len = len;
-    ensure_str_extra_capacity(str_buffer, 2 + len);
-    rb_str_cat(str_buffer, "\x77", 1);
-    rb_str_cat(str_buffer, (char *)&new_len, 1);
-    rb_str_cat(str_buffer, "Elixir.", 7);
-    return rb_str_concat(str_buffer, elixirized);
+    retf_writer_reserve(writer, 2 + len);
+    retf_writer_put_byte(writer, 119);
+    retf_writer_put_byte(writer, len);
   } else {
-    ensure_str_extra_capacity(str_buffer, 3 + len);
-    rb_str_cat(str_buffer, "\x76", 1);
+    retf_writer_reserve(writer, 3 + len);
+    retf_writer_put_byte(writer, 118);
+    retf_writer_put_be16(writer, len);
+  }
 
-    uint16_t nlen = htobe16(len);
+  retf_writer_put_bytes(writer, "Elixir.", 7);
+  retf_writer_put_bytes(writer, RSTRING_PTR(elixirized),
+                        RSTRING_LEN(elixirized));
 
-    rb_str_cat(str_buffer, (char *)&nlen, 2);
-    rb_str_cat(str_buffer, "Elixir.", 7);
-    return rb_str_concat(str_buffer, elixirized);
-  }
+  size_t encoded_len = (len < 256 ? 2 : 3) + len;
+  retf_atom_cache_store_encoded(
+      self, writer->ptr + writer->len - encoded_len, encoded_len);
+  refer_to_atom(writer, self, writer->len - encoded_len);
+
+  RB_GC_GUARD(elixirized);
 }
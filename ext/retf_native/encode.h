@@ -1,13 +1,35 @@
+#ifndef RETF_ENCODE_H
+#define RETF_ENCODE_H
+
 #include <endian.h>
+#include <limits.h>
 #include <math.h>
 #include <ruby.h>
 #include <stdint.h>
 #include <string.h>
 #include <zlib.h>
 
+#include "atom_cache.h"
 #include "constants.h"
+#include "dist_atom_cache.h"
+#include "encoded.h"
+#include "nogvl.h"
+#include "packet.h"
+#include "stack.h"
+#include "stats.h"
+#include "writer.h"
+
+VALUE retf_encode(VALUE self, VALUE to_encode, VALUE compress,
+                  VALUE compress_threshold, VALUE max_depth,
+                  VALUE byte_lists);
+VALUE retf_encode_many(VALUE self, VALUE values, VALUE packet,
+                       VALUE byte_lists);
+VALUE retf_encode_to(VALUE self, VALUE io, VALUE to_encode,
+                     VALUE byte_lists);
 
-VALUE retf_encode(VALUE self, VALUE to_encode, VALUE compress);
+// Appends a single term (without a version byte) to `writer`,
+// with `byte_lists` as in `Retf.encode`.
+void retf_encode_term(VALUE term, retf_writer *writer, int byte_lists);
 
 VALUE retf_encode_integer(int argc, VALUE *argv, VALUE self);
 VALUE retf_encode_float(int argc, VALUE *argv, VALUE self);
@@ -16,3 +38,9 @@ VALUE retf_encode_array(int argc, VALUE *argv, VALUE self);
 VALUE retf_encode_map(int argc, VALUE *argv, VALUE self);
 VALUE retf_encode_atom(int argc, VALUE *argv, VALUE self);
 VALUE retf_encode_class(int argc, VALUE *argv, VALUE self);
+VALUE retf_encode_tuple(int argc, VALUE *argv, VALUE self);
+VALUE retf_encode_pid(int argc, VALUE *argv, VALUE self);
+VALUE retf_encode_reference(int argc, VALUE *argv, VALUE self);
+VALUE retf_encode_bit_binary(int argc, VALUE *argv, VALUE self);
+
+#endif  // RETF_ENCODE_H
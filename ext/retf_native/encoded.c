@@ -0,0 +1,111 @@
+#include "encoded.h"
+
+#include "encode.h"
+
+typedef struct {
+  // The encoded term, without a version byte
+  char *ptr;
+  size_t len;
+} retf_encoded;
+
+static void encoded_free(void *ptr) {
+  retf_encoded *encoded = ptr;
+
+  xfree(encoded->ptr);
+  xfree(encoded);
+}
+
+static size_t encoded_memsize(const void *ptr) {
+  const retf_encoded *encoded = ptr;
+  return sizeof(retf_encoded) + encoded->len;
+}
+
+// Preencoded terms never change after they've been created, so
+// they can be shared between Ractors (e.g. through a constant).
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+#define RETF_ENCODED_FLAGS \
+  (RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE)
+#else
+#define RETF_ENCODED_FLAGS RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+
+static const rb_data_type_t encoded_type = {
+    "Retf::Encoded",
+    {NULL, encoded_free, encoded_memsize},
+    0, 0, RETF_ENCODED_FLAGS,
+};
+
+static VALUE cEncoded;
+
+int retf_encoded_p(VALUE value) {
+  return rb_typeddata_is_kind_of(value, &encoded_type);
+}
+
+void retf_encoded_write(VALUE value, retf_writer *writer) {
+  const retf_encoded *encoded = RTYPEDDATA_DATA(value);
+  retf_writer_put_long_bytes(writer, encoded->ptr, encoded->len);
+}
+
+static retf_encoded *get_encoded(VALUE self) {
+  retf_encoded *encoded;
+  TypedData_Get_Struct(self, retf_encoded, &encoded_type, encoded);
+  return encoded;
+}
+
+/*
+ * Encodes +value+ once so that it can be embedded in any number of
+ * terms passed to Retf.encode, which copy its bytes as they are
+ * instead of walking +value+ again.
+ */
+VALUE retf_preencode(VALUE self, VALUE value, VALUE byte_lists) {
+  VALUE str_buffer = rb_str_buf_new(64);
+
+  retf_writer writer;
+  retf_writer_init(&writer, str_buffer);
+  retf_encode_term(value, &writer, RTEST(byte_lists));
+
+  retf_encoded *encoded;
+  VALUE result =
+      TypedData_Make_Struct(cEncoded, retf_encoded, &encoded_type, encoded);
+
+  encoded->ptr = xmalloc(writer.len);
+  encoded->len = writer.len;
+  memcpy(encoded->ptr, writer.ptr, writer.len);
+
+  RB_GC_GUARD(str_buffer);
+
+  return rb_obj_freeze(result);
+}
+
+/*
+ * The size of the encoded term, without a version byte.
+ */
+static VALUE encoded_bytesize(VALUE self) {
+  return SIZET2NUM(get_encoded(self)->len);
+}
+
+/*
+ * Appends the encoded term to +buffer+ (or a new String), the
+ * same as the other +to_etf+ methods.
+ */
+static VALUE encoded_to_etf(int argc, VALUE *argv, VALUE self) {
+  rb_check_arity(argc, 0, 1);
+
+  retf_encoded *encoded = get_encoded(self);
+
+  if (argc == 0) {
+    return rb_str_new(encoded->ptr, encoded->len);
+  }
+
+  Check_Type(argv[0], T_STRING);
+  return rb_str_cat(argv[0], encoded->ptr, encoded->len);
+}
+
+void retf_encoded_setup(VALUE mRetf) {
+  cEncoded = rb_define_class_under(mRetf, "Encoded", rb_cObject);
+  rb_gc_register_mark_object(cEncoded);
+
+  rb_undef_alloc_func(cEncoded);
+  rb_define_method(cEncoded, "bytesize", encoded_bytesize, 0);
+  rb_define_method(cEncoded, "to_etf", encoded_to_etf, -1);
+}
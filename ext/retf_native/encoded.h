@@ -0,0 +1,21 @@
+#ifndef RETF_ENCODED_H
+#define RETF_ENCODED_H
+
+#include <ruby.h>
+#include <string.h>
+
+#include "writer.h"
+
+// Whether `value` is a Retf::Encoded
+int retf_encoded_p(VALUE value);
+
+// Appends the term held by a Retf::Encoded to `writer`
+void retf_encoded_write(VALUE value, retf_writer *writer);
+
+VALUE retf_preencode(VALUE self, VALUE value, VALUE byte_lists);
+
+// Defines Retf::Encoded, a term encoded ahead of time
+// which the encoder copies into its output as is.
+void retf_encoded_setup(VALUE mRetf);
+
+#endif  // RETF_ENCODED_H
@@ -6,13 +6,22 @@ require 'mkmf'
 # to host byte order and vice versa
 abort('endian.h is required') unless have_header('endian.h')
 
+# compression is done with zlib directly
+abort('zlib is required') unless have_header('zlib.h') && have_library('z', 'deflate')
+
 have_func('rb_str_strlen', 'ruby.h') # truffleruby
 have_func('rb_mod_name', 'ruby.h') # truffleruby
-have_func('rb_big_eq', 'ruby.h') # truffleruby
-have_func('rb_big_and', 'ruby.h') # truffleruby
-have_func('rb_big_rshift', 'ruby.h') # truffleruby
-have_func('rb_big_unpack', 'ruby.h') # truffleruby
 have_func('rb_hash_bulk_insert', 'ruby.h') # TruffleRuby
+have_func('rb_enc_interned_str', 'ruby.h') # TruffleRuby
+
+# inflating, deflating and copying large binaries without the GVL
+have_header('ruby/thread.h')
+have_func('rb_thread_call_without_gvl2', 'ruby/thread.h') # TruffleRuby
+
+have_func('rb_ext_ractor_safe', 'ruby.h') # TruffleRuby
+have_header('ruby/ractor.h')
+have_func('rb_ractor_local_storage_ptr_newkey', 'ruby/ractor.h') # TruffleRuby
+have_func('rb_ractor_make_shareable', 'ruby/ractor.h') # TruffleRuby
 
 append_cflags('-flto')
 create_makefile('retf_native')
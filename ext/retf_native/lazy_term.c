@@ -0,0 +1,351 @@
+#include "lazy_term.h"
+
+typedef struct {
+  // The whole input, frozen so the offsets stay valid
+  VALUE source;
+
+  // Where the tag of this term is
+  size_t offset;
+
+  unsigned char tag;
+
+  // The number of elements, or pairs for a map
+  size_t size;
+
+  // Where each element (or key and value in turn for a map) starts.
+  // Only `indexed` of them are known, further ones are found by
+  // skipping over the last known one when they're first needed.
+  size_t *children;
+  size_t indexed;
+  size_t capa;
+} lazy_term;
+
+static void lazy_term_mark(void *ptr) {
+  lazy_term *term = ptr;
+  rb_gc_mark(term->source);
+}
+
+static void lazy_term_free(void *ptr) {
+  lazy_term *term = ptr;
+
+  xfree(term->children);
+  xfree(term);
+}
+
+static size_t lazy_term_memsize(const void *ptr) {
+  const lazy_term *term = ptr;
+  return sizeof(lazy_term) + term->capa * sizeof(size_t);
+}
+
+static const rb_data_type_t lazy_term_type = {
+    "Retf::LazyTerm",
+    {lazy_term_mark, lazy_term_free, lazy_term_memsize},
+    0, 0, RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE cLazyTerm;
+
+static lazy_term *get_term(VALUE self) {
+  lazy_term *term;
+  TypedData_Get_Struct(self, lazy_term, &lazy_term_type, term);
+  return term;
+}
+
+static inline uint32_t read_int(const char *ptr) {
+  uint32_t num;
+  memcpy(&num, ptr, 4);
+  return be32toh(num);
+}
+
+static void check_remaining(size_t offset, size_t needed, size_t size) {
+  if (RB_UNLIKELY(needed > size - offset)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+}
+
+static VALUE decode_at(VALUE source, size_t offset) {
+  decoder_options options = {0};
+  decoder_state state = {RSTRING_PTR(source), RSTRING_LEN(source), offset,
+                         source, &options};
+
+  VALUE term = retf_decode_state(&state, 0);
+
+  RB_GC_GUARD(source);
+
+  return term;
+}
+
+// Maps, lists and tuples become LazyTerms, anything
+// else is cheap enough to decode straight away.
+static VALUE view_at(VALUE source, size_t offset) {
+  const char *buffer = RSTRING_PTR(source);
+  size_t size = RSTRING_LEN(source);
+
+  check_remaining(offset, 1, size);
+
+  unsigned char tag = buffer[offset];
+  size_t count;
+  size_t header;
+
+  switch (tag) {
+    case 104:
+      check_remaining(offset, 2, size);
+      count = (unsigned char)buffer[offset + 1];
+      header = 2;
+      break;
+    case 105:
+    case 108:
+    case 116:
+      check_remaining(offset, 5, size);
+      count = read_int(buffer + offset + 1);
+      header = 5;
+      break;
+    default:
+      return decode_at(source, offset);
+  }
+
+  // Every element takes at least a byte, so don't trust
+  // a header claiming more than could possibly be there.
+  size_t children = tag == 116 ? count * 2 : count;
+
+  if (RB_UNLIKELY(children > size - offset - header)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+
+  lazy_term *term;
+  VALUE self = TypedData_Make_Struct(cLazyTerm, lazy_term, &lazy_term_type, term);
+
+  term->source = source;
+  term->offset = offset;
+  term->tag = tag;
+  term->size = count;
+
+  if (children > 0) {
+    term->capa = children < 8 ? children : 8;
+    term->children = ALLOC_N(size_t, term->capa);
+    term->children[0] = offset + header;
+    term->indexed = 1;
+  }
+
+  return self;
+}
+
+static size_t skip_term(VALUE source, size_t offset) {
+  retf_scan_state scan = {offset, 1};
+  retf_scan_result result =
+      retf_scan_terms(RSTRING_PTR(source), RSTRING_LEN(source), &scan);
+
+  if (RB_UNLIKELY(result == RETF_SCAN_COMPRESSED)) {
+    rb_raise(rb_eArgError, "unexpected tag: 80");
+  }
+
+  if (RB_UNLIKELY(result == RETF_SCAN_INCOMPLETE)) {
+    rb_raise(rb_eArgError, "Unexpected end of input");
+  }
+
+  return scan.offset;
+}
+
+// Where the `index`th child starts, which must be one there is
+static size_t child_offset(lazy_term *term, size_t index) {
+  while (term->indexed <= index) {
+    if (term->indexed == term->capa) {
+      size_t children = term->tag == 116 ? term->size * 2 : term->size;
+      size_t capa = term->capa * 2 < children ? term->capa * 2 : children;
+
+      REALLOC_N(term->children, size_t, capa);
+      term->capa = capa;
+    }
+
+    size_t last = term->children[term->indexed - 1];
+    term->children[term->indexed++] = skip_term(term->source, last);
+  }
+
+  return term->children[index];
+}
+
+// The atom text a key is decoded from, as far as comparing
+// text is enough to tell whether an atom key is equal to it.
+static int key_atom_text(VALUE key, const char **text, size_t *len) {
+  static const char *names[] = {"nil", "true", "false"};
+
+  const char *name = NULL;
+
+  if (NIL_P(key)) {
+    name = names[0];
+  } else if (key == Qtrue) {
+    name = names[1];
+  } else if (key == Qfalse) {
+    name = names[2];
+  }
+
+  if (name != NULL) {
+    *text = name;
+    *len = strlen(name);
+    return 1;
+  }
+
+  if (!RB_SYMBOL_P(key)) {
+    return 0;
+  }
+
+  VALUE str = rb_sym2str(key);
+  *text = RSTRING_PTR(str);
+  *len = RSTRING_LEN(str);
+
+  // These atoms decode to something other than a Symbol
+  for (int i = 0; i < 3; i++) {
+    if (*len == strlen(names[i]) && memcmp(*text, names[i], *len) == 0) {
+      return 0;
+    }
+  }
+
+  if (*len > 7 && memcmp(*text, "Elixir.", 7) == 0) {
+    return 0;
+  }
+
+  return 1;
+}
+
+// Whether the key at `offset` is an atom with the given text. Like
+// decode, this doesn't distinguish Latin-1 atoms from UTF-8 ones.
+static int atom_key_matches(const char *buffer, size_t size, size_t offset,
+                            const char *text, size_t len) {
+  check_remaining(offset, 1, size);
+
+  unsigned char tag = buffer[offset];
+  size_t header;
+  size_t key_len;
+
+  switch (tag) {
+    case 115:
+    case 119:
+      check_remaining(offset, 2, size);
+      header = 2;
+      key_len = (unsigned char)buffer[offset + 1];
+      break;
+    case 100:
+    case 118:
+      check_remaining(offset, 3, size);
+      header = 3;
+      key_len = ((unsigned char)buffer[offset + 1] << 8) |
+                (unsigned char)buffer[offset + 2];
+      break;
+    default:
+      // Nothing else decodes to a Symbol, nil, true or false
+      return 0;
+  }
+
+  check_remaining(offset + header, key_len, size);
+
+  return key_len == len && memcmp(buffer + offset + header, text, len) == 0;
+}
+
+static VALUE map_lookup(lazy_term *term, VALUE key) {
+  // Only set when `key_atom_text` returns nonzero
+  const char *text = NULL;
+  size_t len = 0;
+  int by_text = key_atom_text(key, &text, &len);
+
+  for (size_t i = 0; i < term->size; i++) {
+    size_t key_offset = child_offset(term, i * 2);
+    int matches;
+
+    // Symbol keys are compared without decoding anything
+    if (by_text) {
+      matches = atom_key_matches(RSTRING_PTR(term->source),
+                                 RSTRING_LEN(term->source), key_offset, text,
+                                 len);
+    } else {
+      matches = rb_eql(decode_at(term->source, key_offset), key);
+    }
+
+    if (matches) {
+      return view_at(term->source, child_offset(term, (i * 2) + 1));
+    }
+  }
+
+  return Qnil;
+}
+
+/*
+ * Looks up +key+ in a map, or the element at index +key+ of a list
+ * or tuple, returning nil if there's no such key or element.
+ *
+ * Maps, lists and tuples are returned as LazyTerms themselves,
+ * anything else is decoded.
+ */
+static VALUE lazy_term_aref(VALUE self, VALUE key) {
+  lazy_term *term = get_term(self);
+
+  if (term->tag == 116) {
+    return map_lookup(term, key);
+  }
+
+  long index = NUM2LONG(key);
+
+  if (index < 0) {
+    index += term->size;
+  }
+
+  if (index < 0 || (size_t)index >= term->size) {
+    return Qnil;
+  }
+
+  return view_at(term->source, child_offset(term, index));
+}
+
+/*
+ * The number of elements in a list or tuple, or pairs in a map.
+ * An improper list's tail isn't counted.
+ */
+static VALUE lazy_term_size(VALUE self) {
+  return SIZET2NUM(get_term(self)->size);
+}
+
+/*
+ * Decodes the whole term, the same as Retf.decode would.
+ */
+static VALUE lazy_term_to_ruby(VALUE self) {
+  lazy_term *term = get_term(self);
+  return decode_at(term->source, term->offset);
+}
+
+/*
+ * Wraps an encoded term without decoding it. Maps, lists and tuples
+ * are returned as a Retf::LazyTerm, anything else is decoded.
+ */
+VALUE retf_view(VALUE self, VALUE str) {
+  Check_Type(str, T_STRING);
+
+  VALUE source = rb_str_new_frozen(str);
+  const char *buffer = RSTRING_PTR(source);
+  size_t size = RSTRING_LEN(source);
+
+  if (size < 1 || (unsigned char)buffer[0] != 131) {
+    rb_raise(rb_eArgError, "malformed ETF");
+  }
+
+  if (size > 1 && buffer[1] == 80) {
+    // Offsets have to point into the uncompressed
+    // term, so that is inflated up front.
+    decoder_options options = {0};
+    decoder_state state = {buffer, size, 2, source, &options};
+
+    source = rb_obj_freeze(retf_inflate_term(&state));
+
+    return view_at(source, 0);
+  }
+
+  return view_at(source, 1);
+}
+
+void retf_lazy_term_setup(VALUE mRetf) {
+  cLazyTerm = rb_define_class_under(mRetf, "LazyTerm", rb_cObject);
+  rb_gc_register_mark_object(cLazyTerm);
+
+  rb_undef_alloc_func(cLazyTerm);
+  rb_define_method(cLazyTerm, "[]", lazy_term_aref, 1);
+  rb_define_method(cLazyTerm, "size", lazy_term_size, 0);
+  rb_define_method(cLazyTerm, "to_ruby", lazy_term_to_ruby, 0);
+}
@@ -0,0 +1,15 @@
+#ifndef RETF_LAZY_TERM_H
+#define RETF_LAZY_TERM_H
+
+#include <ruby.h>
+
+#include "decode.h"
+#include "scan.h"
+
+VALUE retf_view(VALUE self, VALUE str);
+
+// Defines Retf::LazyTerm, a map, list or tuple which
+// is only decoded as far as it is looked into.
+void retf_lazy_term_setup(VALUE mRetf);
+
+#endif  // RETF_LAZY_TERM_H
@@ -0,0 +1,104 @@
+#include "nogvl.h"
+
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+
+typedef struct {
+  retf_nogvl_step step;
+  void *data;
+  int more;
+  volatile int interrupted;
+} steps_call;
+
+static void *run_steps(void *ptr) {
+  steps_call *call = ptr;
+
+  do {
+    call->more = call->step(call->data);
+  } while (call->more && !call->interrupted);
+
+  return NULL;
+}
+
+// Called by Ruby from another thread when this one is interrupted,
+// the step in progress is finished before returning to Ruby.
+static void interrupt_steps(void *ptr) {
+  steps_call *call = ptr;
+
+  call->interrupted = 1;
+}
+
+static VALUE check_interrupts(VALUE unused) {
+  rb_thread_check_ints();
+
+  return Qnil;
+}
+
+int retf_run_steps(retf_nogvl_step step, void *data, int release_gvl) {
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL2
+  if (release_gvl) {
+    steps_call call = {step, data, 1, 0};
+
+    while (1) {
+      call.interrupted = 0;
+
+      // Unlike rb_thread_call_without_gvl this doesn't handle interrupts
+      // itself (which may raise), so they can be handled below instead.
+      // If one is already pending, it returns without running any steps.
+      rb_thread_call_without_gvl2(run_steps, &call, interrupt_steps, &call);
+
+      if (!call.more) {
+        return 0;
+      }
+
+      int error = 0;
+      rb_protect(check_interrupts, Qnil, &error);
+
+      if (error != 0) {
+        return error;
+      }
+    }
+  }
+#endif
+
+  while (step(data)) {
+  }
+
+  return 0;
+}
+
+typedef struct {
+  char *dest;
+  const char *src;
+  size_t len;
+} copy_call;
+
+static int copy_step(void *ptr) {
+  copy_call *call = ptr;
+  size_t len = call->len < RETF_NOGVL_STEP ? call->len : RETF_NOGVL_STEP;
+
+  memcpy(call->dest, call->src, len);
+
+  call->dest += len;
+  call->src += len;
+  call->len -= len;
+
+  return call->len > 0;
+}
+
+int retf_copy_bytes(char *dest, VALUE source, const char *src, size_t len) {
+  if (len < RETF_NOGVL_COPY_MIN) {
+    memcpy(dest, src, len);
+    return 0;
+  }
+
+  VALUE pinned = retf_pin_bytes(source, &src);
+  copy_call call = {dest, src, len};
+
+  int error = retf_run_steps(copy_step, &call, 1);
+
+  RB_GC_GUARD(pinned);
+
+  return error;
+}
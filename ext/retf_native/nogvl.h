@@ -0,0 +1,58 @@
+#ifndef RETF_NOGVL_H
+#define RETF_NOGVL_H
+
+#include <ruby.h>
+#include <stddef.h>
+#include <string.h>
+
+// Inflating and deflating large terms, and copying large binaries,
+// is done without holding the GVL so that other threads keep running
+// meanwhile instead of stalling for as long as that takes.
+//
+// Such work is split into steps which are run until there's nothing
+// left to do. An interrupt (Thread#raise, Thread#kill, a signal) stops
+// it after the current step so it can be handled, and if that raises
+// the caller gets the chance to clean up before re-raising.
+
+// Terms which inflate to, or deflate from, at least this many bytes
+// are compressed and decompressed without the GVL.
+#define RETF_NOGVL_ZLIB_MIN (64 * 1024)
+
+// Binaries at least this long are copied without the GVL. Copying is
+// fast enough that it isn't worth handing the GVL to another thread
+// and then waiting to get it back for anything shorter.
+#define RETF_NOGVL_COPY_MIN (1024 * 1024)
+
+// How many bytes a step produces at most, which bounds
+// how long it takes before an interrupt is handled.
+#define RETF_NOGVL_STEP (1024 * 1024)
+
+// Does the next step of some work, returning
+// nonzero if there's more left to do.
+typedef int (*retf_nogvl_step)(void *data);
+
+// Calls `step` with `data` until it's done, without the GVL if
+// `release_gvl` is nonzero. Returns 0 once it's done, or the tag of
+// the exception an interrupt raised in between steps, which should be
+// re-raised with rb_jump_tag after cleaning up.
+int retf_run_steps(retf_nogvl_step step, void *data, int release_gvl);
+
+// Returns a frozen String sharing the bytes of `str`, and moves `*ptr`
+// (which points into `str`) to the same place in them. The bytes stay
+// where they are while it's alive, even if another thread modifies or
+// frees `str` while the GVL is released.
+static inline VALUE retf_pin_bytes(VALUE str, const char **ptr) {
+  ptrdiff_t offset = *ptr - RSTRING_PTR(str);
+  VALUE pinned = rb_str_new_frozen(str);
+
+  *ptr = RSTRING_PTR(pinned) + offset;
+
+  return pinned;
+}
+
+// Copies `len` bytes from `src`, which points into the String `source`,
+// to `dest`, which other threads mustn't be able to free or move. Large
+// copies are done without the GVL, returns the same as retf_run_steps.
+int retf_copy_bytes(char *dest, VALUE source, const char *src, size_t len);
+
+#endif  // RETF_NOGVL_H
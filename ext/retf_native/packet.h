@@ -0,0 +1,46 @@
+#ifndef RETF_PACKET_H
+#define RETF_PACKET_H
+
+#include <ruby.h>
+#include <stdint.h>
+
+// Helpers for terms preceded by their length, like
+// Erlang's `{packet, N}` socket option.
+
+// Returns the size of the length prefix (1, 2 or 4)
+// for a `packet:` option, or 0 when it's nil.
+static inline int retf_parse_packet(VALUE packet) {
+  if (NIL_P(packet)) {
+    return 0;
+  }
+
+  if (packet == INT2FIX(1) || packet == INT2FIX(2) || packet == INT2FIX(4)) {
+    return FIX2INT(packet);
+  }
+
+  rb_raise(rb_eArgError, "packet must be 1, 2 or 4");
+}
+
+// The largest length a prefix of `packet` bytes can hold
+static inline size_t retf_packet_max(int packet) {
+  return packet == 4 ? UINT32_MAX : ((size_t)1 << (packet * 8)) - 1;
+}
+
+static inline size_t retf_packet_read(const char *ptr, int packet) {
+  size_t size = 0;
+
+  for (int i = 0; i < packet; i++) {
+    size = (size << 8) | (unsigned char)ptr[i];
+  }
+
+  return size;
+}
+
+static inline void retf_packet_write(char *ptr, int packet, size_t size) {
+  for (int i = packet - 1; i >= 0; i--) {
+    ptr[i] = (char)(size & 0xFF);
+    size >>= 8;
+  }
+}
+
+#endif  // RETF_PACKET_H
@@ -1,17 +1,6 @@
 #include "retf_native.h"
 
 void Init_retf_native(void) {
-  // We're just going to use
-  // the Ruby Zlib module
-  // to handle compression.
-  //
-  // Its not the most efficient
-  // but its a lot more battle
-  // tested. We can always
-  // change it later if its
-  // not fast enough.
-  rb_require("zlib");
-
 #ifdef HAVE_RB_EXT_RACTOR_SAFE
   rb_ext_ractor_safe(true);
 #endif
@@ -20,8 +9,13 @@ void Init_retf_native(void) {
 
   VALUE mRetfNative = rb_define_module_under(mRetf, "Native");
 
-  rb_define_module_function(mRetfNative, "decode", retf_decode, 2);
-  rb_define_module_function(mRetfNative, "encode", retf_encode, 2);
+  rb_define_module_function(mRetfNative, "decode", retf_decode, 11);
+  rb_define_module_function(mRetfNative, "encode", retf_encode, 5);
+  rb_define_module_function(mRetfNative, "decode_many", retf_decode_many, 10);
+  rb_define_module_function(mRetfNative, "encode_many", retf_encode_many, 3);
+  rb_define_module_function(mRetfNative, "encode_to", retf_encode_to, 3);
+  rb_define_module_function(mRetfNative, "preencode", retf_preencode, 2);
+  rb_define_module_function(mRetfNative, "view", retf_view, 1);
   rb_define_method(rb_cHash, "to_etf", retf_encode_map, -1);
   rb_define_method(rb_cArray, "to_etf", retf_encode_array, -1);
   rb_define_method(rb_cString, "to_etf", retf_encode_string, -1);
@@ -31,4 +25,19 @@ void Init_retf_native(void) {
   rb_define_method(rb_cSymbol, "to_etf", retf_encode_atom, -1);
 
   retf_constants_setup(mRetf);
+
+  rb_define_method(retf_constants_get_tuple_class(), "to_etf",
+                   retf_encode_tuple, -1);
+  rb_define_method(retf_constants_get_pid_class(), "to_etf", retf_encode_pid,
+                   -1);
+  rb_define_method(retf_constants_get_reference_class(), "to_etf",
+                   retf_encode_reference, -1);
+  rb_define_method(retf_constants_get_bitstring_class(), "to_etf",
+                   retf_encode_bit_binary, -1);
+  retf_atom_cache_setup(mRetfNative);
+  retf_stats_setup(mRetfNative);
+  retf_stream_decoder_setup(mRetf);
+  retf_dist_atom_cache_setup(mRetf);
+  retf_encoded_setup(mRetf);
+  retf_lazy_term_setup(mRetf);
 }
@@ -5,6 +5,11 @@
 
 #include "constants.h"
 #include "decode.h"
+#include "dist_atom_cache.h"
 #include "encode.h"
+#include "encoded.h"
+#include "lazy_term.h"
+#include "stats.h"
+#include "stream_decoder.h"
 
 #endif  // RETF_H
@@ -0,0 +1,108 @@
+#include "scan.h"
+
+#include "tags.h"
+
+// The size of the atom (tag included) starting at `offset`,
+// or 0 if its header hasn't arrived yet.
+static size_t atom_size(const char *buffer, size_t size, size_t offset) {
+  if (offset + 1 > size) {
+    return 0;
+  }
+
+  unsigned char tag = buffer[offset];
+
+  switch (tag) {
+    case 115:
+    case 119:
+    case 100:
+    case 118:
+    case 82:
+      break;
+    default:
+      rb_raise(rb_eArgError, "expected an atom tag, got %u", (unsigned int)tag);
+  }
+
+  retf_tag_layout layout = retf_tag_layout_of(tag);
+
+  if (offset + 1 + layout.header > size) {
+    return 0;
+  }
+
+  return 1 + layout.header + retf_tag_count(tag, layout, buffer + offset + 1);
+}
+
+retf_scan_result retf_scan_terms(const char *buffer, size_t size,
+                                 retf_scan_state *state) {
+  size_t offset = state->offset;
+  uint64_t pending = state->pending;
+  retf_scan_result result = RETF_SCAN_DONE;
+
+  while (pending > 0) {
+    if (offset >= size) {
+      result = RETF_SCAN_INCOMPLETE;
+      break;
+    }
+
+    size_t avail = size - offset;
+    unsigned char tag = buffer[offset];
+
+    // How many bytes the tag, its header and any inline data take up,
+    // and how many terms follow it. Both are only valid once
+    // `header` bytes are available.
+    retf_tag_layout layout = retf_tag_layout_of(tag);
+    size_t header = 1 + layout.header;
+    uint64_t length = 0;
+    uint64_t children = 0;
+
+    switch (layout.kind) {
+      case RETF_TAG_FIXED:
+        break;
+      case RETF_TAG_BYTES:
+        if (avail >= header) {
+          length = retf_tag_count(tag, layout, buffer + offset + 1);
+        }
+        break;
+      case RETF_TAG_TERMS:
+        if (avail >= header) {
+          children = retf_tag_count(tag, layout, buffer + offset + 1);
+        }
+        break;
+      case RETF_TAG_NODE: {
+        // For references the id count comes first, then for
+        // both the node atom and creation, then the ids.
+        size_t node = atom_size(buffer, size, offset + header);
+        size_t creation = tag == 88 || tag == 90 ? 4 : 1;
+
+        if (node == 0) {
+          header = avail + 1;
+        } else if (layout.header == 0) {
+          // Id and serial
+          header += node + creation + 8;
+        } else {
+          header += node + creation;
+          length = retf_tag_count(tag, layout, buffer + offset + 1) * 4;
+        }
+        break;
+      }
+      case RETF_TAG_COMPRESSED:
+        state->offset = offset;
+        state->pending = pending;
+        return RETF_SCAN_COMPRESSED;
+      default:
+        rb_raise(rb_eArgError, "unexpected tag: %u", (unsigned int)tag);
+    }
+
+    if (avail < header || avail - header < length) {
+      result = RETF_SCAN_INCOMPLETE;
+      break;
+    }
+
+    offset += header + length;
+    pending = pending - 1 + children;
+  }
+
+  state->offset = offset;
+  state->pending = pending;
+
+  return result;
+}
@@ -0,0 +1,37 @@
+#ifndef RETF_SCAN_H
+#define RETF_SCAN_H
+
+#include <endian.h>
+#include <ruby.h>
+#include <stdint.h>
+#include <string.h>
+
+// Finds where terms end without decoding them.
+//
+// Rather than recursing into containers, the scanner only counts
+// how many terms are still left to skip: each tag consumes one and
+// containers add their element count. That makes it resumable,
+// when it runs out of input it stops at the start of the term it
+// couldn't finish and can be called again once more bytes arrive.
+typedef struct {
+  // Where the next tag starts
+  size_t offset;
+  // How many terms are still left to skip
+  uint64_t pending;
+} retf_scan_state;
+
+typedef enum {
+  // All pending terms have been skipped
+  RETF_SCAN_DONE,
+  // The input ran out first
+  RETF_SCAN_INCOMPLETE,
+  // Stopped at a compressed term (tag 80) at `offset`,
+  // its size can't be known without inflating it.
+  RETF_SCAN_COMPRESSED,
+} retf_scan_result;
+
+// Raises ArgumentError for tags it doesn't know.
+retf_scan_result retf_scan_terms(const char *buffer, size_t size,
+                                 retf_scan_state *state);
+
+#endif  // RETF_SCAN_H
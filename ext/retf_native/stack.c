@@ -0,0 +1,28 @@
+#include "stack.h"
+
+void retf_stack_grow(retf_stack *stack, size_t count, size_t item_size) {
+  if (RB_UNLIKELY(stack->capa > LONG_MAX / 2 / item_size)) {
+    rb_raise(rb_eNoMemError, "term is nested too deeply");
+  }
+
+  size_t capa = stack->capa * 2;
+
+  volatile VALUE buffer = 0;
+  void *items = rb_alloc_tmp_buffer(&buffer, (long)(capa * item_size));
+
+  memcpy(items, stack->items, count * item_size);
+
+  if (stack->buffer != 0) {
+    rb_free_tmp_buffer(&stack->buffer);
+  }
+
+  stack->items = items;
+  stack->capa = capa;
+  stack->buffer = buffer;
+}
+
+void retf_stack_free(retf_stack *stack) {
+  if (stack->buffer != 0) {
+    rb_free_tmp_buffer(&stack->buffer);
+  }
+}
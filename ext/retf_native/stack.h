@@ -0,0 +1,55 @@
+#ifndef RETF_STACK_H
+#define RETF_STACK_H
+
+#include <ruby.h>
+#include <string.h>
+
+// The encoder and decoder keep the maps, lists and tuples they're
+// part way through on a stack of their own rather than recursing,
+// so how deeply terms can nest is bounded by memory instead of by
+// the C stack of whichever thread (or Ractor) is running them.
+//
+// A stack starts out in storage the caller provides on the C stack
+// and moves into a temporary buffer once it outgrows it. The GC scans
+// both conservatively, so items can hold VALUEs, and the buffer is
+// collected along with everything else if an exception is raised.
+typedef struct {
+  void *items;
+  size_t capa;
+
+  // The temporary buffer `items` lives in, 0 while
+  // it's still the storage the stack started out with.
+  VALUE buffer;
+} retf_stack;
+
+static inline void retf_stack_init(retf_stack *stack, void *storage,
+                                   size_t capa) {
+  stack->items = storage;
+  stack->capa = capa;
+  stack->buffer = 0;
+}
+
+// Doubles the capacity of a stack of `item_size` byte
+// items, of which the first `count` are kept.
+void retf_stack_grow(retf_stack *stack, size_t count, size_t item_size);
+
+// Frees the temporary buffer once the stack isn't needed anymore.
+void retf_stack_free(retf_stack *stack);
+
+// Parses a limit such as `max_depth:`, where nil
+// (0 once parsed) means there isn't one.
+static inline size_t retf_parse_limit(VALUE limit, const char *name) {
+  if (NIL_P(limit)) {
+    return 0;
+  }
+
+  long value = NUM2LONG(limit);
+
+  if (value <= 0) {
+    rb_raise(rb_eArgError, "%s must be positive", name);
+  }
+
+  return (size_t)value;
+}
+
+#endif  // RETF_STACK_H
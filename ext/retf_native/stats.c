@@ -0,0 +1,142 @@
+#include "stats.h"
+
+#ifdef HAVE_RUBY_RACTOR_H
+#include <ruby/ractor.h>
+#endif
+
+rb_atomic_t retf_stats_enabled;
+
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_PTR_NEWKEY
+static rb_ractor_local_key_t stats_key;
+
+static void stats_free(void *ptr) { xfree(ptr); }
+
+static const struct rb_ractor_local_storage_type stats_type = {
+    NULL,
+    stats_free,
+};
+
+retf_stats *retf_stats_current(void) {
+  retf_stats *stats = rb_ractor_local_storage_ptr(stats_key);
+
+  if (RB_UNLIKELY(stats == NULL)) {
+    stats = ZALLOC(retf_stats);
+    rb_ractor_local_storage_ptr_set(stats_key, stats);
+  }
+
+  return stats;
+}
+#else
+// Without Ractor local storage (TruffleRuby) there's a single set
+static retf_stats global_stats;
+
+retf_stats *retf_stats_current(void) { return &global_stats; }
+#endif
+
+// The names in the ETF documentation, for the tags that can be counted
+static const char *const tag_names[256] = {
+    [70] = "new_float_ext",        [77] = "bit_binary_ext",
+    [80] = "compressed",           [82] = "atom_cache_ref",
+    [88] = "new_pid_ext",          [90] = "newer_reference_ext",
+    [97] = "small_integer_ext",    [98] = "integer_ext",
+    [100] = "atom_ext",            [103] = "pid_ext",
+    [104] = "small_tuple_ext",     [105] = "large_tuple_ext",
+    [106] = "nil_ext",             [107] = "string_ext",
+    [108] = "list_ext",            [109] = "binary_ext",
+    [110] = "small_big_ext",       [111] = "large_big_ext",
+    [114] = "new_reference_ext",   [115] = "small_atom_ext",
+    [116] = "map_ext",             [118] = "atom_utf8_ext",
+    [119] = "small_atom_utf8_ext",
+};
+
+static inline VALUE sym(const char *name) { return ID2SYM(rb_intern(name)); }
+
+static VALUE tag_counts_hash(const retf_tag_counts *counts) {
+  VALUE hash = rb_hash_new();
+
+  for (int tag = 0; tag < 256; tag++) {
+    if (counts->terms[tag] == 0) {
+      continue;
+    }
+
+    VALUE key = tag_names[tag] != NULL
+                    ? sym(tag_names[tag])
+                    : rb_to_symbol(rb_sprintf("tag_%d", tag));
+
+    VALUE entry = rb_hash_new_capa(2);
+    rb_hash_aset(entry, sym("terms"), ULL2NUM(counts->terms[tag]));
+    rb_hash_aset(entry, sym("bytes"), ULL2NUM(counts->bytes[tag]));
+    rb_hash_aset(hash, key, entry);
+  }
+
+  return hash;
+}
+
+static VALUE zlib_counts_hash(const retf_zlib_counts *counts) {
+  VALUE hash = rb_hash_new_capa(4);
+  rb_hash_aset(hash, sym("calls"), ULL2NUM(counts->calls));
+  rb_hash_aset(hash, sym("bytes_in"), ULL2NUM(counts->bytes_in));
+  rb_hash_aset(hash, sym("bytes_out"), ULL2NUM(counts->bytes_out));
+  rb_hash_aset(hash, sym("time_ns"), ULL2NUM(counts->time_ns));
+
+  return hash;
+}
+
+static VALUE retf_stats_hash(VALUE self) {
+  retf_stats *stats = retf_stats_current();
+
+  VALUE hash = rb_hash_new_capa(11);
+  rb_hash_aset(hash, sym("enabled"), retf_stats_enabled ? Qtrue : Qfalse);
+  rb_hash_aset(hash, sym("decoded"), tag_counts_hash(&stats->decoded));
+  rb_hash_aset(hash, sym("encoded"), tag_counts_hash(&stats->encoded));
+  rb_hash_aset(hash, sym("from_etf"), ULL2NUM(stats->from_etf));
+  rb_hash_aset(hash, sym("as_etf"), ULL2NUM(stats->as_etf));
+  rb_hash_aset(hash, sym("atom_cache_hits"), ULL2NUM(stats->atom_cache_hits));
+  rb_hash_aset(hash, sym("atom_cache_misses"),
+               ULL2NUM(stats->atom_cache_misses));
+  rb_hash_aset(hash, sym("encode_atom_cache_hits"),
+               ULL2NUM(stats->encode_atom_cache_hits));
+  rb_hash_aset(hash, sym("encode_atom_cache_misses"),
+               ULL2NUM(stats->encode_atom_cache_misses));
+  rb_hash_aset(hash, sym("inflate"), zlib_counts_hash(&stats->inflate));
+  rb_hash_aset(hash, sym("deflate"), zlib_counts_hash(&stats->deflate));
+
+  return hash;
+}
+
+static VALUE retf_stats_reset(VALUE self) {
+  memset(retf_stats_current(), 0, sizeof(retf_stats));
+
+  return Qnil;
+}
+
+static VALUE retf_stats_enable(VALUE self) {
+  RUBY_ATOMIC_SET(retf_stats_enabled, 1);
+
+  return Qnil;
+}
+
+static VALUE retf_stats_disable(VALUE self) {
+  RUBY_ATOMIC_SET(retf_stats_enabled, 0);
+
+  return Qnil;
+}
+
+static VALUE retf_stats_enabled_p(VALUE self) {
+  return retf_stats_enabled ? Qtrue : Qfalse;
+}
+
+void retf_stats_setup(VALUE mRetfNative) {
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_PTR_NEWKEY
+  stats_key = rb_ractor_local_storage_ptr_newkey(&stats_type);
+#endif
+
+  rb_define_module_function(mRetfNative, "stats", retf_stats_hash, 0);
+  rb_define_module_function(mRetfNative, "reset_stats", retf_stats_reset, 0);
+  rb_define_module_function(mRetfNative, "enable_stats", retf_stats_enable,
+                            0);
+  rb_define_module_function(mRetfNative, "disable_stats", retf_stats_disable,
+                            0);
+  rb_define_module_function(mRetfNative, "stats_enabled?",
+                            retf_stats_enabled_p, 0);
+}
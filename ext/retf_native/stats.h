@@ -0,0 +1,72 @@
+#ifndef RETF_STATS_H
+#define RETF_STATS_H
+
+#include <ruby.h>
+#include <ruby/atomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Counts of what was encoded or decoded, by ETF tag. Maps, lists and
+// tuples only count the bytes of their own header, not their elements.
+typedef struct {
+  uint64_t terms[256];
+  uint64_t bytes[256];
+} retf_tag_counts;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t time_ns;
+} retf_zlib_counts;
+
+// Kept per Ractor, like the atom cache, so they're never shared.
+typedef struct {
+  retf_tag_counts decoded;
+  retf_tag_counts encoded;
+  uint64_t from_etf;
+  uint64_t as_etf;
+  uint64_t atom_cache_hits;
+  uint64_t atom_cache_misses;
+  uint64_t encode_atom_cache_hits;
+  uint64_t encode_atom_cache_misses;
+  retf_zlib_counts inflate;
+  retf_zlib_counts deflate;
+} retf_stats;
+
+// Set by `Retf::Native.enable_stats`, shared between all Ractors
+extern rb_atomic_t retf_stats_enabled;
+
+void retf_stats_setup(VALUE mRetfNative);
+
+retf_stats *retf_stats_current(void);
+
+// The current Ractor's counters, or NULL while stats are disabled,
+// so that counting costs a single branch when nobody is looking.
+static inline retf_stats *retf_stats_get(void) {
+  return RB_UNLIKELY(retf_stats_enabled) ? retf_stats_current() : NULL;
+}
+
+static inline void retf_stats_count_tag(retf_tag_counts *counts,
+                                        unsigned char tag, size_t bytes) {
+  counts->terms[tag]++;
+  counts->bytes[tag] += bytes;
+}
+
+static inline uint64_t retf_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline void retf_stats_count_zlib(retf_zlib_counts *counts,
+                                         size_t bytes_in, size_t bytes_out,
+                                         uint64_t started) {
+  counts->calls++;
+  counts->bytes_in += bytes_in;
+  counts->bytes_out += bytes_out;
+  counts->time_ns += retf_stats_now() - started;
+}
+
+#endif  // RETF_STATS_H
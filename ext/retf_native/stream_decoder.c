@@ -0,0 +1,415 @@
+#include "stream_decoder.h"
+
+typedef struct {
+  // Everything fed so far which hasn't been decoded yet starts
+  // at `start`, the bytes before it are dropped once they make
+  // up at least half of the buffer.
+  VALUE buffer;
+  size_t start;
+
+  // 0 for back to back terms, otherwise the
+  // size of the length prefix on every term.
+  int packet;
+
+  decoder_options options;
+
+  // Where the next term was found, set by find_next_term
+  size_t term_start;
+  size_t term_size;
+
+  // How far into a term which hasn't completely arrived the scan
+  // got, relative to `start`, so it can resume from there.
+  int scanning;
+  retf_scan_state scan;
+
+  // Compressed terms don't say how long they are,
+  // so they have to be inflated to find where they end.
+  int inflating;
+  z_stream inflate_stream;
+  size_t inflate_offset;
+  // What the header says the term inflates to, the
+  // scan gives up on a term that inflates to more.
+  uint32_t inflate_size;
+} stream_decoder;
+
+static void stream_decoder_mark(void *ptr) {
+  stream_decoder *decoder = ptr;
+  rb_gc_mark(decoder->buffer);
+}
+
+static void stream_decoder_free(void *ptr) {
+  stream_decoder *decoder = ptr;
+
+  if (decoder->inflating) {
+    inflateEnd(&decoder->inflate_stream);
+  }
+
+  xfree(decoder);
+}
+
+static size_t stream_decoder_memsize(const void *ptr) {
+  return sizeof(stream_decoder);
+}
+
+static const rb_data_type_t stream_decoder_type = {
+    "Retf::Decoder",
+    {stream_decoder_mark, stream_decoder_free, stream_decoder_memsize},
+    0, 0, RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE stream_decoder_alloc(VALUE klass) {
+  stream_decoder *decoder;
+  VALUE self = TypedData_Make_Struct(klass, stream_decoder,
+                                     &stream_decoder_type, decoder);
+
+  decoder->buffer = rb_obj_hide(rb_str_buf_new(0));
+
+  return self;
+}
+
+static stream_decoder *get_decoder(VALUE self) {
+  stream_decoder *decoder;
+  TypedData_Get_Struct(self, stream_decoder, &stream_decoder_type, decoder);
+  return decoder;
+}
+
+static void stop_inflating(stream_decoder *decoder) {
+  if (decoder->inflating) {
+    inflateEnd(&decoder->inflate_stream);
+    decoder->inflating = 0;
+  }
+}
+
+// Inflates as much of the compressed term as has arrived,
+// throwing the output away, until the end of the zlib stream.
+static int find_compressed_end(stream_decoder *decoder, const char *ptr,
+                               size_t avail) {
+  z_stream *stream = &decoder->inflate_stream;
+  Bytef scratch[4096];
+
+  if (!decoder->inflating) {
+    // Version, tag and the uncompressed size
+    if (avail < 6) {
+      return 0;
+    }
+
+    uint32_t size;
+    memcpy(&size, ptr + 2, 4);
+    size = be32toh(size);
+
+    size_t max_decompressed_bytes = decoder->options.max_decompressed_bytes;
+
+    if (max_decompressed_bytes != 0 && size > max_decompressed_bytes) {
+      rb_raise(rb_eArgError, "compressed term inflates to more than "
+                             "max_decompressed_bytes");
+    }
+
+    decoder->inflate_size = size;
+    memset(stream, 0, sizeof(z_stream));
+
+    if (inflateInit(stream) != Z_OK) {
+      rb_raise(rb_eNoMemError, "failed to initialize zlib");
+    }
+
+    decoder->inflating = 1;
+    decoder->inflate_offset = 6;
+  }
+
+  for (;;) {
+    size_t remaining = avail - decoder->inflate_offset;
+
+    if (remaining == 0) {
+      return 0;
+    }
+
+    // The buffer may have moved since the last feed
+    stream->next_in = (Bytef *)ptr + decoder->inflate_offset;
+    stream->avail_in = remaining > UINT_MAX ? UINT_MAX : remaining;
+    stream->next_out = scratch;
+    stream->avail_out = sizeof(scratch);
+
+    int status = inflate(stream, Z_NO_FLUSH);
+
+    decoder->inflate_offset = (const char *)stream->next_in - ptr;
+
+    if (RB_UNLIKELY(stream->total_out > decoder->inflate_size)) {
+      rb_raise(rb_eArgError,
+               "Decompressed data size does not match expected size");
+    }
+
+    if (status == Z_STREAM_END) {
+      decoder->term_size = decoder->inflate_offset;
+      stop_inflating(decoder);
+      return 1;
+    }
+
+    // No progress could be made, the rest hasn't arrived yet
+    if (status == Z_BUF_ERROR) {
+      return 0;
+    }
+
+    if (status != Z_OK) {
+      rb_raise(rb_eArgError, "malformed compressed data");
+    }
+  }
+}
+
+static int find_raw_term(stream_decoder *decoder, const char *ptr,
+                         size_t avail) {
+  if (!decoder->scanning) {
+    if (avail == 0) {
+      return 0;
+    }
+
+    if (RB_UNLIKELY((unsigned char)ptr[0] != 131)) {
+      rb_raise(rb_eArgError, "malformed ETF");
+    }
+
+    decoder->scan.offset = 1;
+    decoder->scan.pending = 1;
+    decoder->scanning = 1;
+  }
+
+  int found;
+
+  if (decoder->inflating) {
+    found = find_compressed_end(decoder, ptr, avail);
+  } else {
+    switch (retf_scan_terms(ptr, avail, &decoder->scan)) {
+      case RETF_SCAN_DONE:
+        decoder->term_size = decoder->scan.offset;
+        found = 1;
+        break;
+      case RETF_SCAN_COMPRESSED:
+        // Only a whole term can be compressed
+        if (decoder->scan.offset != 1) {
+          rb_raise(rb_eArgError, "unexpected tag: 80");
+        }
+
+        found = find_compressed_end(decoder, ptr, avail);
+        break;
+      default:
+        found = 0;
+        break;
+    }
+  }
+
+  size_t max_bytes = decoder->options.max_bytes;
+
+  // Until a term has completely arrived everything
+  // buffered belongs to it, so there's no need to wait.
+  if (max_bytes != 0 && (found ? decoder->term_size : avail) > max_bytes) {
+    rb_raise(rb_eArgError, "term is larger than max_bytes");
+  }
+
+  if (found) {
+    decoder->scanning = 0;
+  }
+
+  return found;
+}
+
+static int find_packet(stream_decoder *decoder, const char *ptr,
+                       size_t avail) {
+  size_t prefix = decoder->packet;
+
+  if (avail < prefix) {
+    return 0;
+  }
+
+  size_t size = retf_packet_read(ptr, decoder->packet);
+
+  // Checked before waiting for the rest to arrive
+  if (decoder->options.max_bytes != 0 && size > decoder->options.max_bytes) {
+    rb_raise(rb_eArgError, "term is larger than max_bytes");
+  }
+
+  if (avail - prefix < size) {
+    return 0;
+  }
+
+  decoder->term_start = decoder->start + prefix;
+  decoder->term_size = size;
+
+  return 1;
+}
+
+// Looks for the next complete term past `start`, returning Qtrue
+// and setting `term_start` and `term_size` if there is one.
+static VALUE find_next_term(VALUE data) {
+  stream_decoder *decoder = (stream_decoder *)data;
+
+  const char *ptr = RSTRING_PTR(decoder->buffer) + decoder->start;
+  size_t avail = RSTRING_LEN(decoder->buffer) - decoder->start;
+
+  if (decoder->packet != 0) {
+    return find_packet(decoder, ptr, avail) ? Qtrue : Qfalse;
+  }
+
+  if (find_raw_term(decoder, ptr, avail)) {
+    decoder->term_start = decoder->start;
+    return Qtrue;
+  }
+
+  return Qfalse;
+}
+
+static void clear_buffer(stream_decoder *decoder) {
+  stop_inflating(decoder);
+  decoder->scanning = 0;
+  decoder->start = 0;
+
+  // Decoding large terms pins the buffer's bytes into a shared
+  // string while the GVL is released, it needs bytes of its own again.
+  rb_str_modify(decoder->buffer);
+  rb_str_set_len(decoder->buffer, 0);
+}
+
+// Drops the bytes which have already been decoded. Only done once
+// they're at least half the buffer, so the bytes moved never
+// outnumber the bytes dropped.
+static void compact_buffer(stream_decoder *decoder) {
+  size_t len = RSTRING_LEN(decoder->buffer);
+  size_t start = decoder->start;
+
+  if (start == 0 || start < len - start) {
+    return;
+  }
+
+  // As in `clear_buffer`, the bytes may be shared with a pinned copy
+  rb_str_modify(decoder->buffer);
+
+  char *ptr = RSTRING_PTR(decoder->buffer);
+  memmove(ptr, ptr + start, len - start);
+  rb_str_set_len(decoder->buffer, len - start);
+  decoder->start = 0;
+}
+
+/*
+ * Appends +chunk+ to the input and decodes every term which has
+ * now completely arrived, yielding each one in order. Without
+ * a block they're returned as an Array instead.
+ *
+ * Bytes of a term which is still incomplete are kept until
+ * the rest of it is fed.
+ *
+ * A term which fails to decode is skipped, but if the input
+ * can't be split into terms at all everything buffered is
+ * thrown away before the error is raised.
+ */
+static VALUE stream_decoder_feed(VALUE self, VALUE chunk) {
+  stream_decoder *decoder = get_decoder(self);
+
+  StringValue(chunk);
+  rb_str_buf_cat(decoder->buffer, RSTRING_PTR(chunk), RSTRING_LEN(chunk));
+
+  int yield = rb_block_given_p();
+  VALUE terms = yield ? Qnil : rb_ary_new();
+
+  for (;;) {
+    int error = 0;
+    VALUE found = rb_protect(find_next_term, (VALUE)decoder, &error);
+
+    if (error) {
+      clear_buffer(decoder);
+      rb_jump_tag(error);
+    }
+
+    if (!RTEST(found)) {
+      break;
+    }
+
+    // Move past the term first, if it turns out to be
+    // malformed the next feed starts after it.
+    size_t term_start = decoder->term_start;
+    size_t term_size = decoder->term_size;
+    decoder->start = term_start + term_size;
+
+    decoder_state state = {RSTRING_PTR(decoder->buffer) + term_start,
+                           term_size, 0, decoder->buffer,
+                           &decoder->options};
+
+    VALUE term = retf_decode_state(&state, 1);
+
+    if (yield) {
+      rb_yield(term);
+    } else {
+      rb_ary_push(terms, term);
+    }
+  }
+
+  compact_buffer(decoder);
+
+  return yield ? self : terms;
+}
+
+/*
+ * The number of bytes fed which haven't been decoded yet.
+ */
+static VALUE stream_decoder_buffered_bytes(VALUE self) {
+  stream_decoder *decoder = get_decoder(self);
+
+  return SIZET2NUM(RSTRING_LEN(decoder->buffer) - decoder->start);
+}
+
+/*
+ * Creates a decoder for terms sent back to back, or with
+ * +packet+ set to 1, 2 or 4, for terms which are each preceded
+ * by their length in that many bytes like Erlang's
+ * <tt>{packet, N}</tt> socket option.
+ *
+ * +atoms+, +dedup_binaries+ and +byte_lists+ are the same
+ * as <tt>Retf.decode</tt>'s, as are the limits +max_depth+, +max_terms+
+ * and +max_decompressed_bytes+ which apply to every term. +max_bytes+
+ * limits how long each term may be, and is checked as soon as the
+ * length prefix or enough of the term has arrived, so that nothing
+ * larger is ever buffered.
+ */
+static VALUE stream_decoder_initialize(int argc, VALUE *argv, VALUE self) {
+  stream_decoder *decoder = get_decoder(self);
+
+  VALUE opts;
+  rb_scan_args(argc, argv, ":", &opts);
+
+  VALUE kwargs[8] = {Qnil, Qnil, Qnil, Qnil, Qnil, Qnil, Qnil, Qnil};
+
+  if (!NIL_P(opts)) {
+    ID keywords[] = {rb_intern("packet"),
+                     rb_intern("atoms"),
+                     rb_intern("dedup_binaries"),
+                     rb_intern("byte_lists"),
+                     rb_intern("max_depth"),
+                     rb_intern("max_bytes"),
+                     rb_intern("max_terms"),
+                     rb_intern("max_decompressed_bytes")};
+    rb_get_kwargs(opts, keywords, 0, 8, kwargs);
+
+    for (int i = 0; i < 8; i++) {
+      if (kwargs[i] == Qundef) {
+        kwargs[i] = Qnil;
+      }
+    }
+  }
+
+  decoder->packet = retf_parse_packet(kwargs[0]);
+  decoder->options.atoms = retf_parse_atoms(kwargs[1]);
+  decoder->options.dedup_threshold = retf_parse_dedup_binaries(kwargs[2]);
+  decoder->options.byte_lists = retf_parse_byte_lists(kwargs[3]);
+  retf_parse_limits(&decoder->options, kwargs[4], kwargs[5], kwargs[6],
+                    kwargs[7]);
+
+  // Binaries are always copied, the buffer they'd point into is reused.
+  decoder->options.share_threshold = 0;
+
+  return self;
+}
+
+void retf_stream_decoder_setup(VALUE mRetf) {
+  VALUE cDecoder = rb_define_class_under(mRetf, "Decoder", rb_cObject);
+
+  rb_define_alloc_func(cDecoder, stream_decoder_alloc);
+  rb_define_method(cDecoder, "initialize", stream_decoder_initialize, -1);
+  rb_define_method(cDecoder, "feed", stream_decoder_feed, 1);
+  rb_define_method(cDecoder, "buffered_bytes",
+                   stream_decoder_buffered_bytes, 0);
+}
@@ -0,0 +1,15 @@
+#ifndef RETF_STREAM_DECODER_H
+#define RETF_STREAM_DECODER_H
+
+#include <ruby.h>
+#include <zlib.h>
+
+#include "decode.h"
+#include "packet.h"
+#include "scan.h"
+
+// Defines Retf::Decoder, which decodes terms
+// from input that arrives in arbitrary chunks.
+void retf_stream_decoder_setup(VALUE mRetf);
+
+#endif  // RETF_STREAM_DECODER_H
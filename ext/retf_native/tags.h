@@ -0,0 +1,117 @@
+#ifndef RETF_TAGS_H
+#define RETF_TAGS_H
+
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+
+// How the term after each tag is laid out, shared by the decoder and
+// the scanner so they can't disagree about where a term ends.
+//
+// `header` bytes follow the tag before the term's data or the terms
+// inside it, and the first `width` of them (if any) are a big endian
+// count of those. Everything after the header is either `count` bytes
+// of data or `count` terms, depending on `kind`.
+typedef enum {
+  // Not a tag the decoder knows
+  RETF_TAG_UNKNOWN,
+  // Nothing but the header
+  RETF_TAG_FIXED,
+  // Followed by `count` bytes of data
+  RETF_TAG_BYTES,
+  // Followed by `count` terms
+  RETF_TAG_TERMS,
+  // PIDs and references, whose size depends on the node atom in them
+  RETF_TAG_NODE,
+  // The header is the uncompressed size, which says
+  // nothing about how much compressed data follows.
+  RETF_TAG_COMPRESSED,
+} retf_tag_kind;
+
+typedef struct {
+  unsigned char kind;
+  unsigned char header;
+  unsigned char width;
+} retf_tag_layout;
+
+static inline retf_tag_layout retf_tag_layout_of(unsigned char tag) {
+  switch (tag) {
+    case 97:  // SMALL_INTEGER_EXT
+    case 82:  // ATOM_CACHE_REF
+      return (retf_tag_layout){RETF_TAG_FIXED, 1, 0};
+    case 98:  // INTEGER_EXT
+      return (retf_tag_layout){RETF_TAG_FIXED, 4, 0};
+    case 70:  // NEW_FLOAT_EXT
+      return (retf_tag_layout){RETF_TAG_FIXED, 8, 0};
+    case 106:  // NIL_EXT
+      return (retf_tag_layout){RETF_TAG_FIXED, 0, 0};
+    case 115:  // SMALL_ATOM_EXT
+    case 119:  // SMALL_ATOM_UTF8_EXT
+      return (retf_tag_layout){RETF_TAG_BYTES, 1, 1};
+    case 100:  // ATOM_EXT
+    case 118:  // ATOM_UTF8_EXT
+    case 107:  // STRING_EXT
+      return (retf_tag_layout){RETF_TAG_BYTES, 2, 2};
+    case 109:  // BINARY_EXT
+      return (retf_tag_layout){RETF_TAG_BYTES, 4, 4};
+    case 110:  // SMALL_BIG_EXT, the count then the sign
+      return (retf_tag_layout){RETF_TAG_BYTES, 2, 1};
+    case 111:  // LARGE_BIG_EXT, the count then the sign
+    case 77:   // BIT_BINARY_EXT, the count then the bits in the last byte
+      return (retf_tag_layout){RETF_TAG_BYTES, 5, 4};
+    case 104:  // SMALL_TUPLE_EXT
+      return (retf_tag_layout){RETF_TAG_TERMS, 1, 1};
+    case 105:  // LARGE_TUPLE_EXT
+    case 108:  // LIST_EXT
+    case 116:  // MAP_EXT
+      return (retf_tag_layout){RETF_TAG_TERMS, 4, 4};
+    case 88:   // NEW_PID_EXT
+    case 103:  // PID_EXT
+      return (retf_tag_layout){RETF_TAG_NODE, 0, 0};
+    case 90:   // NEWER_REFERENCE_EXT
+    case 114:  // NEW_REFERENCE_EXT
+      return (retf_tag_layout){RETF_TAG_NODE, 2, 2};
+    case 80:  // COMPRESSED
+      return (retf_tag_layout){RETF_TAG_COMPRESSED, 4, 4};
+    default:
+      return (retf_tag_layout){RETF_TAG_UNKNOWN, 0, 0};
+  }
+}
+
+// Reads the count at `field`, which must have `layout.width` bytes.
+// Lists are followed by their tail and maps by a key and a value
+// for each pair, so those are included in the count of terms.
+static inline uint64_t retf_tag_count(unsigned char tag, retf_tag_layout layout,
+                                      const char *field) {
+  uint64_t count;
+
+  switch (layout.width) {
+    case 0:
+      return 0;
+    case 1:
+      count = (unsigned char)field[0];
+      break;
+    case 2: {
+      uint16_t num;
+      memcpy(&num, field, 2);
+      count = be16toh(num);
+      break;
+    }
+    default: {
+      uint32_t num;
+      memcpy(&num, field, 4);
+      count = be32toh(num);
+      break;
+    }
+  }
+
+  if (tag == 108) {
+    return count + 1;
+  } else if (tag == 116) {
+    return count * 2;
+  }
+
+  return count;
+}
+
+#endif  // RETF_TAGS_H
@@ -0,0 +1,113 @@
+#include "writer.h"
+
+// Don't bother growing by less than this,
+// most terms are small and this avoids a few
+// tiny reallocations at the start.
+#define RETF_WRITER_MIN_CAPA 128
+
+void retf_writer_init(retf_writer *writer, VALUE str) {
+  // Raises if the string is frozen and makes sure
+  // we aren't writing into a shared buffer.
+  rb_str_modify(str);
+
+  writer->str = str;
+  writer->ptr = RSTRING_PTR(str);
+  writer->len = RSTRING_LEN(str);
+  writer->capa = rb_str_capacity(str);
+  writer->dist_refs = NULL;
+  writer->io = Qnil;
+  writer->flushed = 0;
+}
+
+void retf_writer_grow(retf_writer *writer, size_t required) {
+  if (RB_UNLIKELY(required > SIZE_MAX - writer->len)) {
+    rb_raise(rb_eNoMemError, "encoded term is too large");
+  }
+
+  if (!NIL_P(writer->io)) {
+    retf_writer_write_io(writer, Qnil);
+
+    if (required <= writer->capa) {
+      return;
+    }
+  }
+
+  size_t needed = writer->len + required;
+  size_t new_capa = writer->capa < RETF_WRITER_MIN_CAPA ? RETF_WRITER_MIN_CAPA
+                                                        : writer->capa;
+
+  while (new_capa < needed) {
+    if (new_capa > SIZE_MAX / 2) {
+      new_capa = needed;
+      break;
+    }
+
+    new_capa *= 2;
+  }
+
+  // rb_str_modify_expand expands relative to the
+  // current length so it needs to be up to date first.
+  rb_str_set_len(writer->str, writer->len);
+  rb_str_modify_expand(writer->str, new_capa - writer->len);
+
+  writer->ptr = RSTRING_PTR(writer->str);
+  writer->capa = rb_str_capacity(writer->str);
+}
+
+void retf_writer_flush_len(retf_writer *writer) {
+  rb_str_set_len(writer->str, writer->len);
+}
+
+void retf_writer_sync(retf_writer *writer) {
+  rb_str_modify(writer->str);
+
+  writer->ptr = RSTRING_PTR(writer->str);
+  writer->len = RSTRING_LEN(writer->str);
+  writer->capa = rb_str_capacity(writer->str);
+}
+
+VALUE retf_writer_finish(retf_writer *writer) {
+  rb_str_set_len(writer->str, writer->len);
+  return writer->str;
+}
+
+void retf_writer_write_io(retf_writer *writer, VALUE str) {
+  // The buffer is reused afterwards, so the IO gets a copy
+  // in case it holds on to what it was given.
+  VALUE chunk = rb_str_new(writer->ptr, writer->len);
+  size_t written = writer->len;
+
+  writer->len = 0;
+
+  if (NIL_P(str)) {
+    rb_funcall(writer->io, rb_intern("write"), 1, chunk);
+  } else {
+    // IO#write hands multiple strings to writev
+    rb_funcall(writer->io, rb_intern("write"), 2, chunk, str);
+    written += RSTRING_LEN(str);
+  }
+
+  writer->flushed += written;
+}
+
+void retf_writer_put_long_bytes(retf_writer *writer, const char *bytes,
+                                size_t len) {
+  if (NIL_P(writer->io)) {
+    retf_writer_put_bytes(writer, bytes, len);
+    return;
+  }
+
+  while (len > 0) {
+    if (writer->len == writer->capa) {
+      retf_writer_write_io(writer, Qnil);
+    }
+
+    size_t room = writer->capa - writer->len;
+    size_t step = len < room ? len : room;
+
+    memcpy(writer->ptr + writer->len, bytes, step);
+    writer->len += step;
+    bytes += step;
+    len -= step;
+  }
+}
@@ -0,0 +1,107 @@
+#ifndef RETF_WRITER_H
+#define RETF_WRITER_H
+
+#include <endian.h>
+#include <ruby.h>
+#include <stdint.h>
+#include <string.h>
+
+// The encoder writes through a raw cursor into the backing Ruby
+// string instead of calling rb_str_cat for every field.
+//
+// Capacity is reserved in amortized (doubling) chunks, and the
+// Ruby visible length of the string is only updated when
+// `retf_writer_finish` is called, or around calls back into Ruby
+// code which may want to look at or append to the same string.
+typedef struct {
+  VALUE str;
+  char *ptr;
+  size_t len;
+  size_t capa;
+
+  // Set while encoding the terms after a distribution header,
+  // atoms are then written as references into its atom cache.
+  struct retf_dist_refs *dist_refs;
+
+  // Set by Retf.encode_to, the buffer is then written to this IO
+  // whenever it fills up instead of growing, so `len` only counts
+  // what hasn't been written yet and `flushed` what has.
+  VALUE io;
+  size_t flushed;
+} retf_writer;
+
+// How much is buffered before writing to an IO
+#define RETF_WRITER_IO_CAPA (64 * 1024)
+
+// Strings at least this long are handed to the IO
+// alongside the buffer instead of being copied into it.
+#define RETF_WRITER_IO_DIRECT_MIN (16 * 1024)
+
+void retf_writer_init(retf_writer *writer, VALUE str);
+void retf_writer_grow(retf_writer *writer, size_t required);
+VALUE retf_writer_finish(retf_writer *writer);
+
+// Writes everything buffered to the writer's IO, followed
+// by `str` unless it's nil, in a single call to `write`.
+void retf_writer_write_io(retf_writer *writer, VALUE str);
+
+// Like `retf_writer_put_bytes`, but when writing to an IO
+// copies them a buffer full at a time instead of growing it.
+void retf_writer_put_long_bytes(retf_writer *writer, const char *bytes,
+                                size_t len);
+
+// Makes the string safe to hand to Ruby code
+// by setting its length to what has been written so far.
+void retf_writer_flush_len(retf_writer *writer);
+
+// Picks up any changes Ruby code made to the string
+// since `retf_writer_flush_len` was called.
+void retf_writer_sync(retf_writer *writer);
+
+static inline void retf_writer_reserve(retf_writer *writer, size_t required) {
+  if (RB_UNLIKELY(writer->capa - writer->len < required)) {
+    retf_writer_grow(writer, required);
+  }
+}
+
+// Reserves room for what's likely to be written next, such as the
+// elements of a list. Writing to an IO this is capped at the size of
+// the buffer, which is flushed rather than grown when it fills up.
+static inline void retf_writer_reserve_hint(retf_writer *writer,
+                                            size_t hint) {
+  if (!NIL_P(writer->io) && hint > RETF_WRITER_IO_CAPA) {
+    hint = RETF_WRITER_IO_CAPA;
+  }
+
+  retf_writer_reserve(writer, hint);
+}
+
+static inline void retf_writer_put_byte(retf_writer *writer, unsigned char byte) {
+  retf_writer_reserve(writer, 1);
+  writer->ptr[writer->len++] = (char)byte;
+}
+
+static inline void retf_writer_put_bytes(retf_writer *writer, const void *bytes,
+                                         size_t len) {
+  retf_writer_reserve(writer, len);
+  memcpy(writer->ptr + writer->len, bytes, len);
+  writer->len += len;
+}
+
+// Everything in ETF is in network (big endian) byte order
+static inline void retf_writer_put_be16(retf_writer *writer, uint16_t value) {
+  uint16_t nvalue = htobe16(value);
+  retf_writer_put_bytes(writer, &nvalue, 2);
+}
+
+static inline void retf_writer_put_be32(retf_writer *writer, uint32_t value) {
+  uint32_t nvalue = htobe32(value);
+  retf_writer_put_bytes(writer, &nvalue, 4);
+}
+
+static inline void retf_writer_put_be64(retf_writer *writer, uint64_t value) {
+  uint64_t nvalue = htobe64(value);
+  retf_writer_put_bytes(writer, &nvalue, 8);
+}
+
+#endif  // RETF_WRITER_H
@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require_relative 'retf/bit_binary'
+require_relative 'retf/parallel'
 require_relative 'retf/pid'
 require_relative 'retf/reference'
 require_relative 'retf/tuple'
@@ -38,11 +39,30 @@ module Retf
     # the Ruby class.
     #
     #
+    # Like `term_to_binary/2`, `compress` may be `true`
+    # to use the default zlib level (6) or an explicit
+    # level between 0 and 9. Encoded terms smaller than
+    # `compress_threshold` bytes are left uncompressed.
+    #
+    # Nesting is only limited by memory, unless `max_depth`
+    # is given. Either way a value which contains itself
+    # raises an ArgumentError rather than never finishing.
+    #
+    # With `byte_lists: true` arrays of up to 65535 Integers between
+    # 0 and 255 are encoded as `STRING_EXT`, a byte per element rather
+    # than two, like `term_to_binary` does. Erlang and Elixir decode
+    # them as the same lists, while `decode` returns them as binary
+    # strings unless it's given `byte_lists: :array`.
+    #
     # @param value [Object] the value to encode
-    # @option compress [Boolean] whether to Zlib compress the encoded value
+    # @option compress [Boolean, Integer] whether to Zlib compress the encoded value,
+    #   and optionally at which level
+    # @option compress_threshold [Integer] the minimum encoded size to compress
+    # @option max_depth [Integer, nil] how deeply maps, lists and tuples may be nested
+    # @option byte_lists [Boolean] whether to encode lists of bytes as `STRING_EXT`
     # @return [String] the encoded value
-    def encode(value, compress: false)
-      ::Retf::Native.encode(value, compress)
+    def encode(value, compress: false, compress_threshold: nil, max_depth: nil, byte_lists: false)
+      ::Retf::Native.encode(value, compress, compress_threshold, max_depth, byte_lists)
     end
 
     alias dump encode
@@ -67,13 +87,226 @@ module Retf
     # If you wish to re-use given string,
     # you should pass a copy of it to this method
     # instead.
+    #
+    # When `share_binaries` is enabled, binaries
+    # (and charlists) at least that many bytes long
+    # are returned as frozen strings which share
+    # the given string's memory rather than being copied
+    # out of it. Passing `true` uses a threshold of 1024 bytes.
+    # Keep in mind that any such string keeps the
+    # entire input alive for as long as it is referenced.
+    #
+    # For untrusted input the following limits can be given,
+    # exceeding any of them raises an ArgumentError:
+    #
+    # - `max_bytes` for the length of `value`
+    # - `max_depth` for how deeply maps, lists and tuples are nested
+    # - `max_terms` for the total number of terms
+    # - `max_decompressed_bytes` for what a compressed term inflates to
+    #
+    # Lengths in the input are always checked against how many
+    # bytes are left before anything is allocated for them, and
+    # only the root term may be compressed.
+    #
+    # With `freeze: true` everything decoded is frozen, and can
+    # be shared between Ractors without `Ractor.make_shareable`
+    # having to go over it again. Maps with a `:__struct__` key are
+    # handed to `.from_etf` unfrozen, and what it returns is left as is.
+    #
+    # Atoms become symbols, which are never garbage collected once
+    # referenced from a constant or method name, so input from an
+    # untrusted peer could grow the symbol table without limit. Like
+    # Erlang's `binary_to_term(Bin, [safe])`, `atoms: :existing` only
+    # decodes atoms into symbols which already exist, and into frozen
+    # strings otherwise. `atoms: :string` decodes every atom other than
+    # `true`, `false` and `nil` into a frozen string, which also means
+    # maps with a `:__struct__` key are left as maps.
+    #
+    # With `dedup_binaries: true` binaries of at most 64 bytes (or
+    # `dedup_binaries` bytes, when it's an Integer) are returned as
+    # frozen strings from Ruby's table of interned strings, the same
+    # ones `-"string"` returns. Keys and values repeated across a large
+    # list of maps are then only kept once, rather than once per map.
+    #
+    # `STRING_EXT`, a list of bytes Erlang writes compactly, is decoded
+    # into a binary string unless `byte_lists: :array` is given, in which
+    # case it's an Array of Integers like any other list.
+    #
     # @param value [String] the binary string to decode
-    def decode(value)
-      ::Retf::Native.decode(value, false)
+    # @option share_binaries [Boolean, Integer] whether, or above which size,
+    #   to share binaries with the input rather than copying them
+    # @option max_bytes [Integer, nil] the longest input to accept
+    # @option max_depth [Integer, nil] the deepest nesting to accept
+    # @option max_terms [Integer, nil] the most terms to accept
+    # @option max_decompressed_bytes [Integer, nil] the largest
+    #   uncompressed size to accept
+    # @option freeze [Boolean] whether to deeply freeze the result
+    # @option atoms [Symbol] `:symbol`, `:existing` or `:string`
+    # @option dedup_binaries [Boolean, Integer] whether, or up to which
+    #   size, to return binaries as deduplicated frozen strings
+    # @option byte_lists [Symbol] `:string` or `:array`
+    def decode(value, share_binaries: false, max_bytes: nil, max_depth: nil, max_terms: nil, # rubocop:disable Metrics/ParameterLists
+               max_decompressed_bytes: nil, freeze: false, atoms: :symbol, dedup_binaries: false,
+               byte_lists: :string)
+      ::Retf::Native.decode(value, false, share_binaries, max_depth, max_bytes, max_terms, max_decompressed_bytes,
+                            freeze, atoms, dedup_binaries, byte_lists)
     end
 
     alias load decode
     alias deserialize decode
+
+    # Encodes `value` straight to `io` (anything with a
+    # `write` method), writing it out in pieces as it
+    # is encoded rather than building the whole term
+    # in memory first. Large strings are passed to `write`
+    # alongside what was encoded before them instead of
+    # being copied, which `IO` turns into a single `writev`.
+    #
+    # Compression isn't supported, as the compressed
+    # header needs the size of the whole term up front.
+    #
+    # @param io [IO] where to write the encoded value
+    # @param value [Object] the value to encode
+    # @option byte_lists [Boolean] see `encode`
+    # @return [Integer] the number of bytes written
+    def encode_to(io, value, byte_lists: false)
+      ::Retf::Native.encode_to(io, value, byte_lists)
+    end
+
+    # Wraps an encoded term without decoding it, so that
+    # only the parts which are looked at get decoded.
+    #
+    # Maps, lists and tuples are returned as a `Retf::LazyTerm`
+    # which supports `[]`, `size` and `to_ruby`. Looking up a key
+    # or index skips over everything before it without decoding
+    # it, and again returns maps, lists and tuples as LazyTerms
+    # while decoding anything else.
+    #
+    # A compressed term is inflated up front.
+    #
+    # @param value [String] the binary string to view
+    # @return [Retf::LazyTerm, Object] the viewed term
+    def view(value)
+      ::Retf::Native.view(value)
+    end
+
+    # Encodes every value in `values` into a single string,
+    # each one preceded by its encoded length in `packet`
+    # (1, 2 or 4) bytes like Erlang's `{packet, N}` socket
+    # option. With `packet: nil` the encoded values
+    # directly follow each other instead.
+    #
+    # Raises ArgumentError if a value's encoding
+    # is too long for its length to fit.
+    #
+    # @param values [Array] the values to encode
+    # @option packet [Integer, nil] the size of the length before each value
+    # @option byte_lists [Boolean] see `encode`
+    # @return [String] the encoded values
+    def encode_many(values, packet: 4, byte_lists: false)
+      ::Retf::Native.encode_many(values, packet, byte_lists)
+    end
+
+    # Encodes `value` ahead of time, returning a frozen
+    # `Retf::Encoded` which can be placed anywhere in the
+    # values given to `encode` (or `encode_many` etc.)
+    # to have its bytes copied into the output as is.
+    #
+    # Useful for large constant parts of messages which
+    # would otherwise be encoded again every time. Changes
+    # to `value` afterwards are not picked up.
+    #
+    # @param value [Object] the value to encode
+    # @option byte_lists [Boolean] see `encode`
+    # @return [Retf::Encoded] the encoded value
+    def preencode(value, byte_lists: false)
+      ::Retf::Native.preencode(value, byte_lists)
+    end
+
+    # Decodes a string of terms each preceded by
+    # their length in `packet` (1, 2 or 4) bytes,
+    # such as frames drained from a socket, returning
+    # them all in an Array. With `packet: nil` the
+    # terms are expected to directly follow each other.
+    #
+    # Raises ArgumentError if the last term is incomplete,
+    # see `Retf::Decoder` for input that arrives in pieces.
+    #
+    # Takes the same options as `decode`.
+    #
+    # @param value [String] the binary string to decode
+    # @option packet [Integer, nil] the size of the length before each term
+    # @option share_binaries [Boolean, Integer] see `decode`
+    # @option atoms [Symbol] see `decode`
+    # @option dedup_binaries [Boolean, Integer] see `decode`
+    # @option byte_lists [Symbol] see `decode`
+    # @option max_bytes [Integer, nil] the longest input to accept
+    # @option max_depth [Integer, nil] the deepest nesting to accept in each term
+    # @option max_terms [Integer, nil] the most terms to accept in each term
+    # @option max_decompressed_bytes [Integer, nil] the largest
+    #   uncompressed size to accept for each compressed term
+    # @return [Array] the decoded terms
+    def decode_many(value, packet: 4, share_binaries: false, atoms: :symbol, dedup_binaries: false, # rubocop:disable Metrics/ParameterLists
+                    byte_lists: :string, max_bytes: nil, max_depth: nil, max_terms: nil, max_decompressed_bytes: nil)
+      ::Retf::Native.decode_many(value, packet, share_binaries, atoms, dedup_binaries, byte_lists, max_depth, max_bytes,
+                                 max_terms, max_decompressed_bytes)
+    end
+
+    # Decodes every binary in `binaries` like `decode`,
+    # spread across `workers` Ractors (one per processor
+    # by default), returning the terms in the same order.
+    #
+    # The binaries are frozen, like `decode` may do, so that they can
+    # be passed to the Ractors without copying them. The terms are
+    # decoded with `freeze: true`, and the
+    # returned Array and everything in it is made shareable so
+    # that it doesn't need copying back. Any `.from_etf` methods
+    # called along the way must be callable from other Ractors.
+    #
+    # Batches too small to be worth splitting up
+    # are decoded in the calling Ractor instead.
+    #
+    # Raises the first error any binary fails to decode with.
+    #
+    # @param binaries [Array<String>] the binary strings to decode
+    # @option workers [Integer, nil] how many Ractors to decode with
+    # @option options see `decode`
+    # @return [Array] the decoded terms
+    def decode_parallel(binaries, workers: nil, **options)
+      binaries.each(&:freeze)
+
+      ::Retf::Parallel.map(:decode, binaries, workers, { **options, freeze: true })
+    end
+
+    # Encodes every value in `values` like `encode`, spread
+    # across `workers` Ractors (one per processor by default),
+    # returning the encoded values in the same order.
+    #
+    # The values are copied to the Ractors unless they're
+    # shareable, and any `#as_etf` or `#to_etf` methods they
+    # have must be callable from other Ractors. The returned
+    # Array and its strings are frozen.
+    #
+    # @param values [Array] the values to encode
+    # @option workers [Integer, nil] how many Ractors to encode with
+    # @option options see `encode`
+    # @return [Array<String>] the encoded values
+    def encode_parallel(values, workers: nil, **options)
+      ::Retf::Parallel.map(:encode, values, workers, options)
+    end
+
+    # Forgets which Elixir module names resolve
+    # to Ruby constants when decoding.
+    #
+    # Defining a constant does this automatically through
+    # a `const_added` hook prepended to `Module`, unless
+    # it's defined in a module whose own `const_added`
+    # doesn't call `super`. Removing a constant (e.g.
+    # through `remove_const`) doesn't either, so call this
+    # afterwards if that should be picked up by `decode`.
+    def clear_constant_cache
+      ::Retf::Native.clear_constant_cache
+    end
   end
 end
 
@@ -11,12 +11,6 @@ module Retf
       @bits_size = bits_size
     end
 
-    def to_etf(buffer)
-      buffer << [77, binary.bytesize, bits_size].pack('CNC')
-
-      buffer << binary
-    end
-
     def ==(other)
       other.is_a?(BitBinary) &&
         @bits_size == other.bits_size &&
@@ -0,0 +1,61 @@
+# frozen_string_literal: true
+
+require 'etc'
+
+module Retf
+  # Spreads a batch of values to encode or binaries to decode
+  # across Ractors, see `Retf.encode_parallel` and `Retf.decode_parallel`.
+  module Parallel # :nodoc:
+    # Batches aren't split up so far that
+    # a Ractor gets fewer values than this.
+    MIN_SLICE = 256
+
+    class << self
+      def map(method, values, workers, options)
+        workers = Etc.nprocessors if workers.nil?
+
+        raise ArgumentError, 'workers must be positive' unless workers.is_a?(Integer) && workers.positive?
+
+        workers = [workers, values.size / MIN_SLICE].min
+
+        return run(method, values, options) if workers <= 1 || !defined?(Ractor)
+
+        shareable(start(method, values, workers, options).flat_map { |ractor| result_of(ractor) })
+      end
+
+      def run(method, values, options)
+        shareable(values.map { |value| ::Retf.public_send(method, value, **options) })
+      end
+
+      private
+
+      # Starts a Ractor for each of `workers` slices of `values`
+      def start(method, values, workers, options)
+        slice_size = values.size.fdiv(workers).ceil
+
+        # Slices of shareable values (such as frozen strings) are
+        # passed to the Ractors as they are, anything else gets copied.
+        values.each_slice(slice_size).map do |slice|
+          Ractor.new(method, slice.freeze, options) do |ractor_method, ractor_values, ractor_options|
+            # Errors are raised again by the caller
+            Thread.current.report_on_exception = false
+
+            ::Retf::Parallel.run(ractor_method, ractor_values, ractor_options)
+          end
+        end
+      end
+
+      # Results are made shareable so that they're
+      # handed back without copying them again.
+      def shareable(results)
+        defined?(Ractor) ? Ractor.make_shareable(results) : results.freeze
+      end
+
+      def result_of(ractor)
+        ractor.respond_to?(:value) ? ractor.value : ractor.take
+      rescue Ractor::RemoteError => e
+        raise e.cause, cause: nil
+      end
+    end
+  end
+end
@@ -20,15 +20,6 @@ module Retf
       @creation = creation
     end
 
-    def to_etf(buffer = ''.b)
-      buffer << [88].pack('C')
-
-      @node.to_etf(buffer)
-
-      # 88 is the tag for a PID
-      buffer << [id, serial, creation].pack('NNN')
-    end
-
     def to_s
       "#PID<#{@node} : #{@id}.#{@serial}.#{@creation}>"
     end
@@ -25,13 +25,6 @@ module Retf
         @creation == other.creation
     end
 
-    def to_etf(buffer = ''.b)
-      buffer << [90, @id.size].pack('Cn')
-      @node.to_etf(buffer)
-
-      buffer << [creation, *@id].pack('NN*')
-    end
-
     def to_s
       "#Ref<#{node} : #{creation}.#{id}>"
     end
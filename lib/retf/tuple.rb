@@ -6,6 +6,11 @@ module Retf
   # They are basically frozen arrays with a fixed size.
   # Trying to access an index that is out of bounds
   # will raise an `IndexError`.
+  #
+  # Decoding builds tuples (and encoding reads them)
+  # natively through `@value` and `@size`, so those
+  # must stay as they are set here. `#to_etf` is
+  # defined by the native extension.
   class Tuple
     include Enumerable
 
@@ -46,16 +51,6 @@ module Retf
       value.each(&)
     end
 
-    def to_etf(buffer = ''.b)
-      buffer << if size < 256
-                  [104, size].pack('CC')
-                else
-                  [105, size].pack('CN')
-                end
-
-      value.each { _1.to_etf(buffer) }
-    end
-
     def to_s
       value.to_s
     end
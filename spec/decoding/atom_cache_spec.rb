@@ -0,0 +1,111 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe 'Atom cache' do
+  before { Retf::Native.clear_atom_cache }
+
+  it 'only resolves a repeated atom once' do
+    encoded = [131, 108, 3, 119, 3, 'foo', 119, 3, 'foo', 119, 3, 'foo', 106].pack('CCNCCa*CCa*CCa*C')
+
+    expect(Retf.decode(encoded)).to eq %i[foo foo foo]
+
+    stats = Retf::Native.atom_cache_stats
+
+    expect(stats[:misses]).to eq 1
+    expect(stats[:hits]).to eq 2
+    expect(stats[:size]).to eq 1
+  end
+
+  it 'caches the special atoms' do
+    encoded = [131, 108, 2, 119, 3, 'nil', 119, 3, 'nil', 106].pack('CCNCCa*CCa*C')
+
+    expect(Retf.decode(encoded)).to eq [nil, nil]
+    expect(Retf::Native.atom_cache_stats[:hits]).to eq 1
+  end
+
+  it 'decodes nil correctly when it is not the last thing in the input' do
+    encoded = [131, 108, 2, 119, 3, 'nil', 97, 1, 106].pack('CCNCCa*CCC')
+
+    expect(Retf.decode(encoded)).to eq [nil, 1]
+  end
+
+  it 'does not grow beyond its capacity' do
+    capacity = Retf::Native.atom_cache_stats[:capacity]
+
+    (capacity * 2).times do |i|
+      atom = "atom_#{i}"
+      Retf.decode([131, 119, atom.bytesize, atom].pack('CCCa*'))
+    end
+
+    stats = Retf::Native.atom_cache_stats
+
+    expect(stats[:size]).to be <= capacity
+    expect(stats[:evictions]).to be > 0
+  end
+
+  describe 'module names' do
+    let(:encoded) do
+      str = 'Elixir.RetfCacheSpecModule'
+
+      [131, 119, str.bytesize, str].pack('CCCa*')
+    end
+
+    after do
+      Object.send(:remove_const, :RetfCacheSpecModule) if Object.const_defined?(:RetfCacheSpecModule)
+    end
+
+    it 'caches the resolved constant' do
+      stub_const = Module.new
+      Object.const_set(:RetfCacheSpecModule, stub_const)
+
+      expect(Retf.decode(encoded)).to eq stub_const
+      expect(Retf.decode(encoded)).to eq stub_const
+
+      stats = Retf::Native.atom_cache_stats
+
+      expect(stats[:misses]).to eq 1
+      expect(stats[:hits]).to eq 1
+    end
+
+    it 'resolves to the constant once it is defined' do
+      expect(Retf.decode(encoded)).to eq :'Elixir.RetfCacheSpecModule'
+
+      stub_const = Module.new
+      Object.const_set(:RetfCacheSpecModule, stub_const)
+
+      expect(Retf.decode(encoded)).to eq stub_const
+    end
+
+    it 'is re-resolved after the constant cache is cleared' do
+      stub_const = Module.new
+      Object.const_set(:RetfCacheSpecModule, stub_const)
+
+      expect(Retf.decode(encoded)).to eq stub_const
+
+      Object.send(:remove_const, :RetfCacheSpecModule)
+      Retf.clear_constant_cache
+
+      expect(Retf.decode(encoded)).to eq :'Elixir.RetfCacheSpecModule'
+    end
+
+    it 'misses constants defined where const_added does not call super' do
+      inner = [131, 119, 32, 'Elixir.RetfCacheSpecModule.Inner'].pack('CCCa*')
+      parent = Class.new do
+        def self.const_added(_name); end
+      end
+      Object.const_set(:RetfCacheSpecModule, parent)
+
+      expect(Retf.decode(inner)).to eq :'Elixir.RetfCacheSpecModule.Inner'
+
+      stub_const = Module.new
+      parent.const_set(:Inner, stub_const)
+
+      expect(Retf.decode(inner)).to eq :'Elixir.RetfCacheSpecModule.Inner'
+
+      Retf.clear_constant_cache
+
+      expect(Retf.decode(inner)).to eq stub_const
+    end
+  end
+end
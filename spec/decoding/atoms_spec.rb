@@ -0,0 +1,99 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe 'Decoding atoms' do
+  def atom(name)
+    [131, 119, name.bytesize, name].pack('CCCa*')
+  end
+
+  # A name no symbol has been created for yet
+  def unknown_name
+    "retf_unknown_atom_#{rand(2**64)}"
+  end
+
+  describe 'atoms: :existing' do
+    it 'decodes atoms which already exist into symbols' do
+      expect(Retf.decode(atom('hello'), atoms: :existing)).to eq :hello
+    end
+
+    it 'decodes other atoms into frozen strings without creating symbols' do
+      name = unknown_name
+      symbols = Symbol.all_symbols.size
+
+      decoded = Retf.decode(atom(name), atoms: :existing)
+
+      expect(decoded).to eq name
+      expect(decoded).to be_frozen
+      expect(decoded.encoding).to eq Encoding::UTF_8
+      expect(Symbol.all_symbols.size).to eq symbols
+    end
+
+    it 'decodes an atom into a symbol once it exists' do
+      name = unknown_name
+
+      expect(Retf.decode(atom(name), atoms: :existing)).to eq name
+
+      name.to_sym
+
+      expect(Retf.decode(atom(name), atoms: :existing)).to eq name.to_sym
+    end
+
+    it 'decodes true, false, nil and Elixir modules' do
+      encoded = Retf.encode([true, false, nil, Test::MyClass.new(1, 'a')])
+
+      expect(Retf.decode(encoded, atoms: :existing)).to eq [true, false, nil, Test::MyClass.new(1, 'a')]
+    end
+
+    it 'decodes unknown Elixir modules into frozen strings' do
+      name = "Elixir.#{unknown_name.capitalize}"
+
+      expect(Retf.decode(atom(name), atoms: :existing)).to eq name
+    end
+  end
+
+  describe 'atoms: :string' do
+    it 'decodes every atom into a frozen string' do
+      decoded = Retf.decode(Retf.encode(%i[hello world]), atoms: :string)
+
+      expect(decoded).to eq %w[hello world]
+      expect(decoded).to all(be_frozen)
+    end
+
+    it 'decodes true, false and nil' do
+      expect(Retf.decode(Retf.encode([true, false, nil]), atoms: :string)).to eq [true, false, nil]
+    end
+
+    it 'leaves structs as maps' do
+      decoded = Retf.decode(Retf.encode(Test::MyClass.new(1, 'a')), atoms: :string)
+
+      expect(decoded).to eq('__struct__' => 'Elixir.Test.MyClass', 'a' => 1, 'b' => 'a')
+    end
+  end
+
+  it 'decodes atoms into symbols with atoms: :symbol' do
+    name = unknown_name
+
+    expect(Retf.decode(atom(name), atoms: :symbol)).to eq name.to_sym
+  end
+
+  it 'takes atoms: in decode_many' do
+    encoded = Retf.encode_many(%i[hello world], packet: 4)
+
+    expect(Retf.decode_many(encoded, atoms: :string)).to eq %w[hello world]
+  end
+
+  it 'takes atoms: in Retf::Decoder' do
+    decoder = Retf::Decoder.new(atoms: :string)
+
+    expect(decoder.feed(Retf.encode(:hello))).to eq ['hello']
+  end
+
+  it 'raises on anything else' do
+    expect { Retf.decode(atom('hello'), atoms: :strings) }.to raise_error(
+      ArgumentError, 'atoms must be :symbol, :existing or :string'
+    )
+  end
+end
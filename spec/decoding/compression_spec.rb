@@ -35,4 +35,62 @@ RSpec.describe 'zlib deflated etf' do
 
     expect(Retf.decode(encoded_large_array)).to eq([(2**32) - 1, (2**63) - 1])
   end
+
+  it 'raises an error when the uncompressed size is wrong' do
+    compressed = Zlib::Deflate.deflate([70, 42.0].pack('CG'))
+
+    too_small = [131, 80, 8, compressed].pack('CCNa*')
+    too_large = [131, 80, 10, compressed].pack('CCNa*')
+
+    expect { Retf.decode(too_small) }.to raise_error(ArgumentError, 'Decompressed data size does not match expected size')
+    expect { Retf.decode(too_large) }.to raise_error(ArgumentError, 'Decompressed data size does not match expected size')
+  end
+
+  it 'raises an error for an impossibly large uncompressed size' do
+    encoded = [131, 80, 4_000_000_000, 120, 156].pack('CCNCC')
+
+    expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'Decompressed data size does not match expected size')
+  end
+
+  it 'raises an error for malformed compressed data' do
+    encoded = [131, 80, 9, 'not zlib data'].pack('CCNa*')
+
+    expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'malformed compressed data')
+  end
+
+  it 'raises an error for truncated compressed data' do
+    compressed = Zlib::Deflate.deflate('a' * 1000)
+
+    encoded = [131, 80, 1005, compressed.byteslice(0, 5)].pack('CCNa*')
+
+    expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'Unexpected end of input')
+  end
+
+  it 'decodes terms which inflate to many megabytes' do
+    term = Array.new(3) { |i| "#{i} log line\n" * 200_000 }
+
+    expect(Retf.decode(Retf.encode(term, compress: true))).to eq(term)
+  end
+
+  it 'raises an error for large terms which are truncated' do
+    encoded = Retf.encode(Random.new(1).bytes(1 << 20), compress: true)
+
+    expect { Retf.decode(encoded.byteslice(0, 1 << 19)) }.to raise_error(ArgumentError, 'Unexpected end of input')
+  end
+
+  it 'can be interrupted while inflating a large term' do
+    encoded = Retf.encode('a' * (64 << 20), compress: true)
+    decoding = Queue.new
+
+    thread = Thread.new do
+      decoding << true
+      loop { Retf.decode(encoded) }
+    end
+
+    thread.report_on_exception = false
+    decoding.pop
+    thread.raise(Interrupt)
+
+    expect { thread.join }.to raise_error(Interrupt)
+  end
 end
@@ -0,0 +1,66 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe Retf::AtomCache do
+  subject(:cache) { described_class.new }
+
+  it 'decodes atom cache references defined in the header' do
+    # One new entry in segment 0 at index 5, then a reference to it
+    message = [131, 68, 1, 0b1000, 5, 3, 'foo', 82, 0].pack('C5Ca*CC')
+
+    expect(cache.decode(message)).to eq [:foo]
+  end
+
+  it 'remembers entries for later messages' do
+    cache.decode([131, 68, 1, 0b1011, 5, 3, 'foo', 82, 0].pack('C5Ca*CC'))
+
+    # Segment 3, index 5 again, this time without the atom text
+    message = [131, 68, 1, 0b0011, 5, 104, 2, 82, 0, 97, 1].pack('C*')
+
+    expect(cache.decode(message)).to eq [Retf::Tuple[:foo, 1]]
+  end
+
+  it 'decodes headers with long atoms' do
+    long = 'a' * 300
+    header = [131, 68, 2, 0b1000_1000, 1].pack('C*') +
+             [0, 3, 'foo'].pack('Cna*') + [2, 300, long].pack('Cna*')
+    message = header + [108, 2, 82, 0, 82, 1, 106].pack('CNC*')
+
+    expect(cache.decode(message)).to eq [[:foo, long.to_sym]]
+  end
+
+  it 'decodes every term after the header' do
+    message = [131, 68, 0, 97, 1, 119, 2, 'ok'].pack('C7a*')
+
+    expect(cache.decode(message)).to eq [1, :ok]
+  end
+
+  it 'resolves cached module names and special atoms' do
+    name = 'Elixir.Test.MyOtherClass'
+    message = [131, 68, 2, 0b1000_1000, 0, 0, 4, 'true', 1, name.bytesize, name]
+              .pack('C7a*CCa*') + [104, 2, 82, 0, 82, 1].pack('C*')
+
+    expect(cache.decode(message)).to eq [Retf::Tuple[true, Test::MyOtherClass]]
+  end
+
+  it 'raises an ArgumentError for references to an empty slot' do
+    expect { cache.decode([131, 68, 1, 0, 5, 82, 0].pack('C*')) }
+      .to raise_error(ArgumentError, 'atom cache reference to an empty slot')
+  end
+
+  it 'raises an ArgumentError for references past the end of the header' do
+    expect { cache.decode([131, 68, 0, 82, 0].pack('C*')) }
+      .to raise_error(ArgumentError, 'invalid atom cache reference')
+  end
+
+  it 'raises an ArgumentError without a distribution header' do
+    expect { cache.decode(Retf.encode(:ok)) }.to raise_error(ArgumentError, 'expected a distribution header')
+  end
+
+  it 'is not used by Retf.decode' do
+    expect { Retf.decode([131, 82, 0].pack('C*')) }.to raise_error(ArgumentError, 'invalid atom cache reference')
+  end
+end
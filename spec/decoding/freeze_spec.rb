@@ -0,0 +1,63 @@
+# frozen_string_literal: true
+
+require 'retf'
+require_relative '../support/test_classes'
+
+RSpec.describe 'Decoding frozen terms' do
+  def deeply_frozen?(term)
+    case term
+    when Hash then term.frozen? && term.all? { |key, value| deeply_frozen?(key) && deeply_frozen?(value) }
+    when Array then term.frozen? && term.all? { |element| deeply_frozen?(element) }
+    when Retf::Tuple then term.frozen? && deeply_frozen?(term.value)
+    when Retf::Reference then term.frozen? && deeply_frozen?(term.id)
+    when Retf::BitBinary then term.frozen? && term.binary.frozen?
+    else term.frozen?
+    end
+  end
+
+  let(:term) do
+    [
+      { name: 'ann', 'roles' => [:admin, 2**70, 1.5e300], nested: { list: [], tuple: Retf::Tuple.new('a', 1) } },
+      Retf::PID.new(1, 2, 3, :'node@host'),
+      Retf::Reference.new(1, [1, 2, 3], :'node@host'),
+      Retf::BitBinary.new("\xff".b, 3),
+      Retf::Tuple.new
+    ]
+  end
+
+  it 'leaves terms unfrozen by default' do
+    decoded = Retf.decode(Retf.encode(term))
+
+    expect(decoded).not_to be_frozen
+    expect(decoded.first[:name]).not_to be_frozen
+  end
+
+  it 'freezes everything decoded' do
+    decoded = Retf.decode(Retf.encode(term), freeze: true)
+
+    expect(decoded).to eq(term)
+    expect(deeply_frozen?(decoded)).to be(true)
+  end
+
+  it 'decodes terms which are shareable between Ractors' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    expect(Ractor.shareable?(Retf.decode(Retf.encode(term), freeze: true))).to be(true)
+  end
+
+  it 'freezes binaries shared with the input' do
+    decoded = Retf.decode(Retf.encode(['a' * 2048]), freeze: true, share_binaries: true)
+
+    expect(deeply_frozen?(decoded)).to be(true)
+    expect(Ractor.shareable?(decoded)).to be(true) if defined?(Ractor)
+  end
+
+  it 'leaves maps passed to from_etf and what it returns unfrozen' do
+    decoded = Retf.decode(Retf.encode([{ __struct__: Test::PassThrough, a: 'b' }]), freeze: true)
+
+    expect(decoded).to be_frozen
+    expect(decoded.first).to eq({ __struct__: Test::PassThrough, a: 'b' })
+    expect(decoded.first).not_to be_frozen
+    expect(Ractor.shareable?(decoded)).to be(false) if defined?(Ractor)
+  end
+end
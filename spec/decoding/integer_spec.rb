@@ -61,6 +61,24 @@ RSpec.describe Integer do
 
       expect(Retf.decode(encoded)).to eq int
     end
+
+    it 'decodes a big integer with the top bit of its last byte set' do
+      encoded = [131, 110, 8, 0, 1, 0, 0, 0, 0, 0, 0, 128].pack('C*')
+
+      expect(Retf.decode(encoded)).to eq (2**63) + 1
+    end
+
+    it 'decodes a big integer that fits in a fixnum' do
+      encoded = [131, 110, 2, 1, 0, 1].pack('C*')
+
+      expect(Retf.decode(encoded)).to eq(-256)
+    end
+
+    it 'rejects a truncated big integer' do
+      encoded = [131, 110, 6, 0, 0, 0, 4].pack('C*')
+
+      expect { Retf.decode(encoded) }.to raise_error(ArgumentError)
+    end
   end
 
   describe 'large big integers' do
@@ -103,5 +121,14 @@ RSpec.describe Integer do
 
       expect(Retf.decode(encoded)).to eq int
     end
+
+    it 'roundtrips integers of every size' do
+      [8, 255, 256, 4096].each do |bytes|
+        int = (1 << ((bytes * 8) - 1)) | 0xDEADBEEF
+
+        expect(Retf.decode(Retf.encode(int))).to eq int
+        expect(Retf.decode(Retf.encode(-int))).to eq(-int)
+      end
+    end
   end
 end
@@ -0,0 +1,113 @@
+# frozen_string_literal: true
+
+require 'retf'
+require 'zlib'
+
+RSpec.describe 'Decode limits' do
+  let(:nested) { Retf.encode([{ a: [Retf::Tuple.new(1, 2)] }]) }
+
+  it 'decodes within every limit' do
+    decoded = Retf.decode(nested, max_depth: 4, max_bytes: nested.bytesize, max_terms: 9)
+
+    expect(decoded).to eq(Retf.decode(nested))
+  end
+
+  it 'limits the size of the input' do
+    expect { Retf.decode(nested, max_bytes: nested.bytesize - 1) }
+      .to raise_error(ArgumentError, 'input is larger than max_bytes')
+  end
+
+  it 'limits how deeply terms are nested' do
+    expect { Retf.decode(nested, max_depth: 3) }
+      .to raise_error(ArgumentError, 'term is nested deeper than max_depth')
+  end
+
+  it 'counts nesting separately for every branch' do
+    wide = Retf.encode([[1], [2], { a: [3] }])
+
+    expect(Retf.decode(wide, max_depth: 3)).to eq([[1], [2], { a: [3] }])
+  end
+
+  it 'limits the number of terms' do
+    # The list, map, key, inner list, tuple, its two elements
+    # and the tails of both lists
+    expect(Retf.decode(nested, max_terms: 9)).to eq(Retf.decode(nested))
+    expect { Retf.decode(nested, max_terms: 8) }
+      .to raise_error(ArgumentError, 'input has more terms than max_terms')
+  end
+
+  it 'limits what compressed terms inflate to' do
+    encoded = Retf.encode('a' * 10_000, compress: true)
+
+    expect(Retf.decode(encoded, max_decompressed_bytes: 10_005)).to eq('a' * 10_000)
+    expect { Retf.decode(encoded, max_decompressed_bytes: 10_000) }
+      .to raise_error(ArgumentError, /max_decompressed_bytes/)
+  end
+
+  it 'applies limits to the terms inside a compressed term' do
+    encoded = Retf.encode([[[1]]], compress: true)
+
+    expect { Retf.decode(encoded, max_depth: 2) }.to raise_error(ArgumentError, /max_depth/)
+  end
+
+  it 'rejects compressed terms nested inside other terms' do
+    inner = Retf.encode('a' * 1000, compress: true).byteslice(1..)
+    list = [131, 108, 2, inner * 2, 106].pack('CCNa*C')
+    compressed = Zlib::Deflate.deflate(list.byteslice(1..))
+    nested = [131, 80, list.bytesize - 1, compressed].pack('CCNa*')
+
+    expect { Retf.decode(list) }.to raise_error(ArgumentError, 'unexpected tag: 80')
+    expect { Retf.decode(nested, max_decompressed_bytes: 1500) }.to raise_error(ArgumentError, 'unexpected tag: 80')
+  end
+
+  it 'decodes terms nested deeper than the C stack could hold' do
+    depth = 200_000
+    encoded = ([131] + ([108, 0, 0, 0, 1] * depth) + ([106] * (depth + 1))).pack('C*')
+
+    decoded = Retf.decode(encoded)
+
+    expect(Retf.encode(decoded)).to eq(encoded)
+    expect { Retf.decode(encoded, max_depth: depth - 1) }.to raise_error(ArgumentError, /max_depth/)
+  end
+
+  it 'rejects limits which are not positive' do
+    expect { Retf.decode(nested, max_depth: 0) }.to raise_error(ArgumentError, 'max_depth must be positive')
+  end
+
+  describe 'with decode_many' do
+    let(:frames) { Retf.encode_many([[{ a: [Retf::Tuple.new(1, 2)] }], :ok]) }
+
+    it 'decodes within every limit' do
+      decoded = Retf.decode_many(frames, max_depth: 4, max_bytes: frames.bytesize, max_terms: 9,
+                                         max_decompressed_bytes: 100)
+
+      expect(decoded).to eq(Retf.decode_many(frames))
+    end
+
+    it 'limits the size of the input' do
+      expect { Retf.decode_many(frames, max_bytes: frames.bytesize - 1) }
+        .to raise_error(ArgumentError, 'input is larger than max_bytes')
+    end
+
+    it 'limits how deeply every term is nested' do
+      expect { Retf.decode_many(frames, max_depth: 3) }
+        .to raise_error(ArgumentError, 'term is nested deeper than max_depth')
+    end
+
+    it 'limits the number of terms in every term' do
+      expect { Retf.decode_many(frames, max_terms: 8) }
+        .to raise_error(ArgumentError, 'input has more terms than max_terms')
+    end
+
+    it 'limits what compressed terms inflate to' do
+      encoded = Retf.encode('a' * 10_000, compress: true)
+
+      expect { Retf.decode_many(encoded, packet: nil, max_decompressed_bytes: 10_000) }
+        .to raise_error(ArgumentError, /max_decompressed_bytes/)
+    end
+
+    it 'rejects limits which are not positive' do
+      expect { Retf.decode_many(frames, max_terms: 0) }.to raise_error(ArgumentError, 'max_terms must be positive')
+    end
+  end
+end
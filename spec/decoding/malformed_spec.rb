@@ -20,4 +20,19 @@ RSpec.describe 'Malformed ETF' do
 
     expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'Unexpected end of input')
   end
+
+  describe 'lengths larger than the input' do
+    [
+      ['map', [131, 116, 0xFFFFFFFF].pack('CCN')],
+      ['list', [131, 108, 0xFFFFFFFF, 106].pack('CCNC')],
+      ['large tuple', [131, 105, 0xFFFFFFFF].pack('CCN')],
+      ['small tuple', [131, 104, 255, 97, 1].pack('C*')],
+      ['binary', [131, 109, 0xFFFFFFFF].pack('CCN')],
+      ['big integer', [131, 111, 0xFFFFFFFF, 0].pack('CCNC')]
+    ].each do |name, encoded|
+      it "raises before allocating for a #{name}" do
+        expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'Unexpected end of input')
+      end
+    end
+  end
 end
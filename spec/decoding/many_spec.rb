@@ -0,0 +1,40 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe 'Retf.decode_many' do
+  let(:values) { [:ok, { a: [1, 2] }, 'binary', Retf::Tuple[1, 2.5]] }
+
+  [1, 2, 4].each do |size|
+    it "decodes terms with a #{size} byte length" do
+      expect(Retf.decode_many(Retf.encode_many(values, packet: size), packet: size)).to eq values
+    end
+  end
+
+  it 'decodes back to back terms without a packet size' do
+    expect(Retf.decode_many(values.map { Retf.encode(_1) }.join, packet: nil)).to eq values
+  end
+
+  it 'decodes compressed terms' do
+    encoded = values.map { Retf.encode(_1, compress: true) }.map { [_1.bytesize, _1].pack('Na*') }.join
+
+    expect(Retf.decode_many(encoded)).to eq values
+  end
+
+  it 'returns an empty array for an empty string' do
+    expect(Retf.decode_many('')).to eq []
+  end
+
+  it 'raises an ArgumentError for an incomplete term' do
+    encoded = Retf.encode_many(values)
+
+    expect { Retf.decode_many(encoded[0..-2]) }.to raise_error(ArgumentError, 'Unexpected end of input')
+    expect { Retf.decode_many(encoded + "\x00\x00") }.to raise_error(ArgumentError, 'Unexpected end of input')
+  end
+
+  it 'checks the version of every term' do
+    encoded = Retf.encode_many([:ok]) + [2, 97, 1].pack('NCC')
+
+    expect { Retf.decode_many(encoded) }.to raise_error(ArgumentError, 'malformed ETF')
+  end
+end
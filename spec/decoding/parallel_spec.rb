@@ -0,0 +1,77 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe 'Decoding across Ractors' do
+  let(:values) do
+    Array.new(1000) { |i| { id: i, name: "user #{i}", tags: %i[a b], at: Retf::Tuple.new(i, i * 1.5) } }
+  end
+
+  let(:binaries) { values.map { |value| Retf.encode(value) } }
+
+  it 'decodes in Ractors other than the main one' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    term = [
+      { a: [1, 2**70, 1.5], 'b' => 'c' }, Retf::Tuple.new(:ok, nil),
+      Retf::PID.new(1, 2, 3, :'node@host'), Retf::Reference.new(1, [1, 2, 3], :'node@host'),
+      Retf::BitBinary.new("\xff".b, 3), Retf::Tuple
+    ]
+    encoded = Ractor.make_shareable(Retf.encode(term, compress: true))
+
+    decoded = Ractor.new(encoded) do |binary|
+      [Retf.decode(binary), Retf.view(binary)[0][:a].to_ruby, Retf.decode_many(Retf.encode_many([binary]))]
+    end.take
+
+    expect(decoded).to eq([term, [1, 2**70, 1.5], [encoded]])
+  end
+
+  it 'keeps a separate atom cache in every Ractor' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    Retf.decode(Retf.encode(%i[a a a]))
+
+    stats = Ractor.new do
+      Retf.decode(Retf.encode(%i[a a a]))
+      Retf::Native.atom_cache_stats
+    end.take
+
+    expect(stats.slice(:hits, :misses)).to eq(hits: 2, misses: 1)
+  end
+
+  it 'decodes a batch in order' do
+    expect(Retf.decode_parallel(binaries, workers: 3)).to eq(values)
+  end
+
+  it 'returns shareable terms' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    expect(Ractor.shareable?(Retf.decode_parallel(binaries, workers: 2))).to be(true)
+  end
+
+  it 'freezes the binaries' do
+    Retf.decode_parallel(binaries, workers: 2)
+
+    expect(binaries).to all(be_frozen)
+  end
+
+  it 'decodes small batches without splitting them up' do
+    expect(Retf.decode_parallel(binaries.take(3), workers: 4)).to eq(values.take(3))
+    expect(Retf.decode_parallel([])).to eq([])
+  end
+
+  it 'passes options on to decode' do
+    expect { Retf.decode_parallel(binaries, workers: 2, max_depth: 1) }
+      .to raise_error(ArgumentError, 'term is nested deeper than max_depth')
+  end
+
+  it 'raises the error a binary fails to decode with' do
+    malformed = [*binaries, [131, 0].pack('C*')]
+
+    expect { Retf.decode_parallel(malformed, workers: 2) }.to raise_error(ArgumentError, 'unexpected tag: 0')
+  end
+
+  it 'raises an error for a number of workers which is not positive' do
+    expect { Retf.decode_parallel(binaries, workers: 0) }.to raise_error(ArgumentError, 'workers must be positive')
+  end
+end
@@ -11,4 +11,18 @@ RSpec.describe Retf::PID do
 
     expect(Retf.decode(encoded)).to eq(expected_pid)
   end
+
+  it 'decodes a PID_EXT pid with a 1 byte creation' do
+    node = :'nonode@nohost'.to_etf
+
+    encoded = [131, 103, node, 105, 7, 2].pack('CCa*NNC')
+
+    expect(Retf.decode(encoded)).to eq(described_class.new(105, 7, 2, :'nonode@nohost'))
+  end
+
+  it 'decodes a pid which encodes back to the same bytes' do
+    encoded = Retf.encode(described_class.new(2**32 - 1, 1, 2**31, :'node@host'))
+
+    expect(Retf.encode(Retf.decode(encoded))).to eq(encoded)
+  end
 end
@@ -17,4 +17,20 @@ RSpec.describe Retf::Reference do
 
     expect(Retf.decode(encoded)).to eq(expected_reference)
   end
+
+  it 'decodes a NEW_REFERENCE_EXT reference with a 1 byte creation' do
+    node = :'nonode@nohost'.to_etf
+
+    encoded = [131, 114, 3, node, 2, 1, 2, 3].pack('CCna*CN*')
+
+    expect(Retf.decode(encoded)).to eq(described_class.new(2, [1, 2, 3], :'nonode@nohost'))
+  end
+
+  it 'raises an ArgumentError when the ids are cut short' do
+    node = :'nonode@nohost'.to_etf
+
+    encoded = [131, 90, 3, node, 2, 1, 2].pack('CCna*NN*')
+
+    expect { Retf.decode(encoded) }.to raise_error(ArgumentError, 'Unexpected end of input')
+  end
 end
@@ -0,0 +1,92 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe 'Decoding stats' do
+  before do
+    Retf::Native.enable_stats
+    Retf::Native.reset_stats
+  end
+
+  after do
+    Retf::Native.disable_stats
+    Retf::Native.reset_stats
+  end
+
+  it 'counts nothing while disabled' do
+    Retf::Native.disable_stats
+    Retf.decode(Retf.encode([1, 'a', :b]))
+
+    expect(Retf::Native.stats_enabled?).to be(false)
+    expect(Retf::Native.stats[:decoded]).to eq({})
+  end
+
+  it 'counts terms and their bytes by tag' do
+    encoded = Retf.encode([1, 'ab', :ok, { a: 2**64 }])
+
+    Retf.decode(encoded)
+
+    expect(Retf::Native.stats[:decoded]).to eq(
+      list_ext: { terms: 1, bytes: 5 },
+      small_integer_ext: { terms: 1, bytes: 2 },
+      binary_ext: { terms: 1, bytes: 7 },
+      small_atom_utf8_ext: { terms: 2, bytes: 7 },
+      map_ext: { terms: 1, bytes: 5 },
+      small_big_ext: { terms: 1, bytes: 12 },
+      nil_ext: { terms: 1, bytes: 1 }
+    )
+    expect(Retf::Native.stats[:decoded].sum { |_tag, counts| counts[:bytes] }).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts from_etf calls and atom cache lookups' do
+    Retf::Native.clear_atom_cache
+    encoded = Retf.encode([Test::MyClass.new(1, 'a'), Test::MyClass.new(2, 'b')])
+    Retf::Native.reset_stats
+
+    Retf.decode(encoded)
+    stats = Retf::Native.stats
+
+    expect(stats[:from_etf]).to eq 2
+    expect([stats[:atom_cache_hits], stats[:atom_cache_misses]]).to eq([4, 4])
+  end
+
+  it 'counts what was inflated' do
+    encoded = Retf.encode('a' * 100_000, compress: true)
+
+    Retf.decode(encoded)
+    inflate = Retf::Native.stats[:inflate]
+
+    expect(inflate.slice(:calls, :bytes_in, :bytes_out)).to eq(calls: 1, bytes_in: encoded.bytesize - 6,
+                                                               bytes_out: 100_005)
+    expect(inflate[:time_ns]).to be_positive
+    expect(Retf::Native.stats[:decoded][:compressed]).to eq(terms: 1, bytes: encoded.bytesize - 1)
+  end
+
+  it 'counts nothing after a reset' do
+    Retf.decode(Retf.encode([1, 2, 3]))
+    Retf::Native.reset_stats
+
+    expect(Retf::Native.stats).to eq(
+      enabled: true, decoded: {}, encoded: {}, from_etf: 0, as_etf: 0,
+      atom_cache_hits: 0, atom_cache_misses: 0, encode_atom_cache_hits: 0, encode_atom_cache_misses: 0,
+      inflate: { calls: 0, bytes_in: 0, bytes_out: 0, time_ns: 0 },
+      deflate: { calls: 0, bytes_in: 0, bytes_out: 0, time_ns: 0 }
+    )
+  end
+
+  it 'keeps separate stats in every Ractor' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    encoded = Ractor.make_shareable(Retf.encode([1, 2]))
+
+    decoded = Ractor.new(encoded) do |binary|
+      Retf.decode(binary)
+      Retf::Native.stats[:decoded]
+    end.take
+
+    expect(decoded[:small_integer_ext]).to eq(terms: 2, bytes: 4)
+    expect(Retf::Native.stats[:decoded]).to eq({})
+  end
+end
@@ -0,0 +1,167 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe Retf::Decoder do
+  let(:values) do
+    [
+      { hello: 'world', list: [1, 2.5, -300, 2**70], nested: { tuple: Retf::Tuple[:ok, 'x' * 300] } },
+      :atom,
+      Retf::PID.new(1, 2, 3, :'nonode@nohost'),
+      Retf::Reference.new(1, [1, 2, 3], :'nonode@nohost'),
+      'binary',
+      []
+    ]
+  end
+
+  let(:encoded) { values.map { Retf.encode(_1) } }
+
+  it 'decodes terms fed all at once' do
+    expect(described_class.new.feed(encoded.join)).to eq values
+  end
+
+  it 'decodes terms fed one byte at a time' do
+    decoder = described_class.new
+    decoded = []
+
+    encoded.join.each_char { |byte| decoder.feed(byte) { decoded << _1 } }
+
+    expect(decoded).to eq values
+    expect(decoder.buffered_bytes).to eq 0
+  end
+
+  it 'yields each term as soon as it has arrived' do
+    decoder = described_class.new
+    first, second = encoded
+
+    expect(decoder.feed(first + second[0, 3])).to eq [values[0]]
+    expect(decoder.buffered_bytes).to eq 3
+    expect(decoder.feed(second[3..])).to eq [values[1]]
+  end
+
+  it 'decodes compressed terms split across chunks' do
+    decoder = described_class.new
+    input = Retf.encode(values, compress: true) + Retf.encode(:after)
+
+    decoded = input.chars.each_slice(7).flat_map { decoder.feed(_1.join) }
+
+    expect(decoded).to eq [values, :after]
+  end
+
+  [1, 2, 4].each do |size|
+    it "decodes terms with a #{size} byte length prefix" do
+      format = { 1 => 'C', 2 => 'n', 4 => 'N' }.fetch(size)
+      fitting = encoded.select { _1.bytesize < 256**size }
+      input = fitting.map { [_1.bytesize].pack(format) + _1 }.join
+      decoder = described_class.new(packet: size)
+
+      decoded = input.chars.each_slice(5).flat_map { decoder.feed(_1.join) }
+
+      expect(decoded).to eq(fitting.map { Retf.decode(_1) })
+    end
+  end
+
+  it 'skips a length prefixed term that fails to decode' do
+    decoder = described_class.new(packet: 4)
+    bad = [131, 255].pack('CC')
+    good = Retf.encode(:ok)
+
+    expect { decoder.feed([bad.bytesize, bad].pack('Na*')) }.to raise_error(ArgumentError)
+    expect(decoder.feed([good.bytesize, good].pack('Na*'))).to eq [:ok]
+  end
+
+  it 'throws away the buffer when the input cannot be split into terms' do
+    decoder = described_class.new
+
+    expect { decoder.feed([131, 108, 0, 0, 0, 1, 255].pack('C*')) }.to raise_error(ArgumentError, 'unexpected tag: 255')
+    expect(decoder.buffered_bytes).to eq 0
+    expect(decoder.feed(Retf.encode(:ok))).to eq [:ok]
+  end
+
+  describe 'with terms large enough to be decoded without the GVL' do
+    let(:inputs) { [Retf.encode('x' * 2_000_000), Retf.encode('y' * 100_000, compress: true), Retf.encode(:after)] }
+
+    [nil, 4].each do |packet|
+      context "with packet: #{packet.inspect}" do
+        let(:input) { inputs.map { packet ? [_1.bytesize].pack('N') + _1 : _1 }.join }
+
+        it 'decodes them fed all at once' do
+          expect(described_class.new(packet:).feed(input)).to eq ['x' * 2_000_000, 'y' * 100_000, :after]
+        end
+
+        it 'decodes them split across feeds' do
+          decoder = described_class.new(packet:)
+
+          decoded = (0...input.bytesize).step(300_001).flat_map { decoder.feed(input.byteslice(_1, 300_001)) }
+
+          expect(decoded).to eq ['x' * 2_000_000, 'y' * 100_000, :after]
+          expect(decoder.buffered_bytes).to eq 0
+        end
+      end
+    end
+  end
+
+  describe 'with limits' do
+    let(:nested) { Retf.encode([[[1]]]) }
+
+    it 'rejects a length prefix over max_bytes before the term arrives' do
+      decoder = described_class.new(packet: 4, max_bytes: 1024)
+
+      expect { decoder.feed([0xFFFFFFFF, 131].pack('NC')) }
+        .to raise_error(ArgumentError, 'term is larger than max_bytes')
+      expect(decoder.buffered_bytes).to eq 0
+    end
+
+    it 'rejects a term once more than max_bytes of it has arrived' do
+      decoder = described_class.new(max_bytes: 100)
+      encoded = Retf.encode('x' * 200)
+
+      expect(decoder.feed(encoded[0, 50])).to eq []
+      expect { decoder.feed(encoded[50, 60]) }.to raise_error(ArgumentError, 'term is larger than max_bytes')
+      expect(decoder.buffered_bytes).to eq 0
+      expect(decoder.feed(Retf.encode(:ok))).to eq [:ok]
+    end
+
+    it 'decodes terms within max_bytes' do
+      expect(described_class.new(max_bytes: nested.bytesize).feed(nested * 2)).to eq [[[[1]]]] * 2
+    end
+
+    it 'limits how deeply terms are nested' do
+      expect { described_class.new(max_depth: 2).feed(nested) }
+        .to raise_error(ArgumentError, 'term is nested deeper than max_depth')
+    end
+
+    it 'limits the number of terms' do
+      expect { described_class.new(max_terms: 3).feed(nested) }
+        .to raise_error(ArgumentError, 'input has more terms than max_terms')
+    end
+
+    it 'rejects a compressed term inflating to more than max_decompressed_bytes' do
+      decoder = described_class.new(max_decompressed_bytes: 10_000)
+
+      expect { decoder.feed(Retf.encode('a' * 20_000, compress: true)[0, 10]) }
+        .to raise_error(ArgumentError, /max_decompressed_bytes/)
+    end
+
+    it 'stops inflating a compressed term past the size in its header' do
+      # Claims to inflate to 16 bytes but inflates to far more
+      bomb = Retf.encode('a' * 100_000, compress: true)
+      bomb[2, 4] = [16].pack('N')
+
+      expect { described_class.new.feed(bomb[0, 200]) }
+        .to raise_error(ArgumentError, 'Decompressed data size does not match expected size')
+    end
+
+    it 'rejects limits which are not positive' do
+      expect { described_class.new(max_bytes: 0) }.to raise_error(ArgumentError, 'max_bytes must be positive')
+    end
+  end
+
+  it 'rejects a term without a version byte' do
+    expect { described_class.new.feed([97, 1].pack('CC')) }.to raise_error(ArgumentError, 'malformed ETF')
+  end
+
+  it 'rejects unsupported packet sizes' do
+    expect { described_class.new(packet: 3) }.to raise_error(ArgumentError)
+  end
+end
@@ -1,5 +1,6 @@
 # frozen_string_literal: true
 
+require 'objspace'
 require 'retf'
 require 'securerandom'
 
@@ -73,4 +74,119 @@ RSpec.describe String do
 
     expect(Retf.decode(encoded)).to eq 'hello there!'
   end
+
+  describe 'with byte_lists: :array' do
+    it 'decodes Erlang style strings into lists of integers' do
+      encoded = [131, 108, 2, 107, 2, 'hi', 107, 0, 106].pack('CCNCna*CnC')
+
+      expect(Retf.decode(encoded, byte_lists: :array)).to eq [[104, 105], []]
+    end
+
+    it 'freezes the lists with freeze: true' do
+      decoded = Retf.decode([131, 107, 1, 'a'].pack('CCna*'), byte_lists: :array, freeze: true)
+
+      expect(decoded).to eq [97]
+      expect(decoded).to be_frozen
+    end
+
+    it 'raises on lists longer than the input' do
+      encoded = [131, 107, 10, 'abc'].pack('CCna*')
+
+      expect { Retf.decode(encoded, byte_lists: :array) }.to raise_error(ArgumentError, 'Unexpected end of input')
+    end
+
+    it 'is accepted by decode_many and Retf::Decoder' do
+      encoded = [6, 131, 107, 2, 1, 2].pack('NCCnCC')
+
+      expect(Retf.decode_many(encoded, byte_lists: :array)).to eq [[1, 2]]
+      expect(Retf::Decoder.new(packet: 4, byte_lists: :array).feed(encoded)).to eq [[1, 2]]
+    end
+
+    it 'raises on anything else' do
+      expect { Retf.decode(Retf.encode(1), byte_lists: :list) }.to raise_error(
+        ArgumentError, 'byte_lists must be :string or :array'
+      )
+    end
+  end
+
+  describe 'with share_binaries' do
+    let(:large) { SecureRandom.bytes(10_000_000) }
+
+    it 'returns large binaries as frozen strings sharing the input' do
+      encoded = [131, 108, 2, 109, large.bytesize, large, 109, 3, 'abc', 106].pack('CCNCNa*CNa*C')
+
+      decoded = Retf.decode(encoded, share_binaries: true)
+
+      expect(decoded).to eq [large, 'abc']
+      expect(decoded.first).to be_frozen
+      expect(decoded.first.encoding).to eq Encoding::BINARY
+      expect(ObjectSpace.memsize_of(decoded.first)).to be < 1024
+      expect(decoded.last).not_to be_frozen
+    end
+
+    it 'accepts a size threshold' do
+      encoded = [131, 108, 2, 109, 3, 'abc', 109, 2, 'de', 106].pack('CCNCNa*CNa*C')
+
+      decoded = Retf.decode(encoded, share_binaries: 3)
+
+      expect(decoded).to eq %w[abc de]
+      expect(decoded.map(&:frozen?)).to eq [true, false]
+    end
+
+    it 'shares binaries inside compressed terms' do
+      encoded = Retf.encode(large, compress: true)
+
+      expect(Retf.decode(encoded, share_binaries: true)).to eq large
+    end
+  end
+
+  describe 'with dedup_binaries' do
+    let(:rows) { Array.new(100) { |i| { 'id' => i, 'status' => 'active' } } }
+
+    it 'returns repeated binaries as the same frozen string' do
+      decoded = Retf.decode(Retf.encode(rows), dedup_binaries: true)
+
+      expect(decoded).to eq rows
+      expect(decoded.flat_map(&:keys).map(&:object_id).uniq.size).to eq 2
+      expect(decoded.map { |row| row['status'].object_id }.uniq.size).to eq 1
+      expect(decoded.first['status']).to be_frozen
+      expect(decoded.first['status'].encoding).to eq Encoding::BINARY
+    end
+
+    it 'returns the same strings across calls' do
+      first = Retf.decode(Retf.encode('active'), dedup_binaries: true)
+
+      expect(Retf.decode(Retf.encode('active'), dedup_binaries: true)).to equal first
+    end
+
+    it 'accepts a size threshold' do
+      encoded = Retf.encode(%w[abc de])
+
+      decoded = Retf.decode(encoded, dedup_binaries: 2)
+
+      expect(decoded).to eq %w[abc de]
+      expect(decoded.map(&:frozen?)).to eq [false, true]
+    end
+
+    it 'deduplicates Erlang strings' do
+      encoded = [131, 108, 2, 107, 2, 'ab', 107, 2, 'ab', 106].pack('CCNCna*Cna*C')
+
+      decoded = Retf.decode(encoded, dedup_binaries: true)
+
+      expect(decoded.first).to equal decoded.last
+    end
+
+    it 'raises on binaries longer than the input' do
+      encoded = [131, 109, 10, 'abc'].pack('CCNa*')
+
+      expect { Retf.decode(encoded, dedup_binaries: true) }.to raise_error(ArgumentError, 'Unexpected end of input')
+    end
+
+    it 'is accepted by decode_many and Retf::Decoder' do
+      encoded = Retf.encode_many(%w[abc abc])
+
+      expect(Retf.decode_many(encoded, dedup_binaries: true).map(&:object_id).uniq.size).to eq 1
+      expect(Retf::Decoder.new(packet: 4, dedup_binaries: true).feed(encoded).map(&:frozen?)).to eq [true, true]
+    end
+  end
 end
@@ -48,6 +48,14 @@ RSpec.describe Retf::Tuple do
     end
   end
 
+  it 'decodes into a tuple with a frozen value' do
+    tuple = Retf.decode([131, 104, 2, 97, 1, 97, 2].pack('C*'))
+
+    expect(tuple.value).to be_frozen
+    expect(tuple.size).to eq 2
+    expect(tuple[1]).to eq 2
+  end
+
   describe 'large tuples' do
     it 'decodes a tuple with 256 elements' do
       expected_elements = Array.new(256) { _1 }
@@ -0,0 +1,95 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe Retf::LazyTerm do
+  let(:message) do
+    {
+      type: :publish,
+      tenant: 'acme',
+      nil => 'nil key',
+      'string key' => 1,
+      42 => :int_key,
+      payload: { rows: [1, 2, [3, 4]], meta: Retf::Tuple.new(:ok, 2**70, 'x' * 2000) }
+    }
+  end
+
+  let(:view) { Retf.view(Retf.encode(message)) }
+
+  it 'looks up keys of a map' do
+    expect(view[:type]).to eq(:publish)
+    expect(view[:tenant]).to eq('acme')
+    expect(view[nil]).to eq('nil key')
+    expect(view['string key']).to eq(1)
+    expect(view[42]).to eq(:int_key)
+    expect(view[:missing]).to be_nil
+    expect(view[:nil]).to be_nil
+  end
+
+  it 'returns maps, lists and tuples as lazy terms' do
+    payload = view[:payload]
+
+    expect(payload).to be_a(described_class)
+    expect(payload[:rows]).to be_a(described_class)
+    expect(payload[:rows][2][1]).to eq(4)
+    expect(payload[:rows][-1].to_ruby).to eq([3, 4])
+    expect(payload[:rows][3]).to be_nil
+    expect(payload[:meta][1]).to eq(2**70)
+    expect(payload[:meta][2]).to eq('x' * 2000)
+  end
+
+  it 'knows the size of maps, lists and tuples' do
+    expect(view.size).to eq(6)
+    expect(view[:payload][:rows].size).to eq(3)
+    expect(view[:payload][:meta].size).to eq(3)
+  end
+
+  it 'decodes the whole term' do
+    expect(view.to_ruby).to eq(Retf.decode(Retf.encode(message)))
+  end
+
+  it 'decodes anything other than a map, list or tuple' do
+    expect(Retf.view(Retf.encode('binary'))).to eq('binary')
+    expect(Retf.view(Retf.encode([]))).to eq([])
+  end
+
+  it 'views compressed terms' do
+    view = Retf.view(Retf.encode(message, compress: true))
+
+    expect(view[:payload][:meta][0]).to eq(:ok)
+  end
+
+  it 'is not affected by changes to the input' do
+    input = Retf.encode({ a: [1, 2] })
+    view = Retf.view(input)
+    input.replace(Retf.encode({ b: 1 }))
+
+    expect(view[:a][1]).to eq(2)
+  end
+
+  it 'matches keys in any atom encoding' do
+    # ATOM_EXT, SMALL_ATOM_EXT and ATOM_UTF8_EXT keys
+    encoded = [131, 116, 3, 100, 2, 'ok', 97, 1, 115, 1, 'a', 97, 2, 118, 5, 'café', 97, 3]
+              .pack('CCNCna*CCCCa*CCCna*CC')
+
+    view = Retf.view(encoded)
+
+    expect(view[:ok]).to eq(1)
+    expect(view[:a]).to eq(2)
+    expect(view[:café]).to eq(3)
+  end
+
+  it 'rejects truncated terms when they are reached' do
+    encoded = Retf.encode({ a: 1, b: [1, 2, 3] }).byteslice(0..-3)
+    view = Retf.view(encoded)
+
+    expect(view[:b][0]).to eq(1)
+    expect { view[:b][2] }.to raise_error(ArgumentError)
+  end
+
+  it 'rejects sizes larger than the input' do
+    encoded = [131, 108, 1_000_000, 106].pack('CCNC')
+
+    expect { Retf.view(encoded) }.to raise_error(ArgumentError)
+  end
+end
@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'retf'
+require 'stringio'
 
 RSpec.describe Array do
   it 'encodes an empty array' do
@@ -27,4 +28,56 @@ RSpec.describe Array do
 
     expect(encoded).to eq(expected)
   end
+
+  describe 'with byte_lists' do
+    it 'encodes lists of bytes as STRING_EXT' do
+      encoded = Retf.encode([0, 1, 255], byte_lists: true)
+
+      expect(encoded.bytes).to eq [131, 107, 0, 3, 0, 1, 255]
+    end
+
+    it 'encodes byte lists nested in other terms' do
+      encoded = Retf.encode({ ids: [104, 105] }, byte_lists: true)
+
+      expect(encoded).to eq [131, 116, 1, 119, 3, 'ids', 107, 2, 'hi'].pack('CCNCCa*Cna*')
+    end
+
+    it 'encodes lists with anything else as lists' do
+      [[1, 256], [1, -1], [1, 2.0], [1, nil], ['a'], [2**64]].each do |list|
+        expect(Retf.encode(list, byte_lists: true)).to eq Retf.encode(list)
+      end
+    end
+
+    it 'encodes long lists as STRING_EXT after checking every element' do
+      list = Array.new(1000) { |i| i % 256 }
+
+      expect(Retf.encode(list, byte_lists: true)).to eq [131, 107, 1000, *list].pack('CCnC*')
+      expect(Retf.encode(list + [256], byte_lists: true)).to eq Retf.encode(list + [256])
+    end
+
+    it 'encodes lists longer than STRING_EXT allows as lists' do
+      list = [1] * 65_536
+
+      expect(Retf.encode(list, byte_lists: true)).to eq Retf.encode(list)
+    end
+
+    it 'is accepted by every other way of encoding' do
+      value = [1, 2, 3]
+      term = [107, 3, 1, 2, 3].pack('CnC*')
+      io = StringIO.new(+'', 'wb')
+
+      Retf.encode_to(io, value, byte_lists: true)
+
+      expect(io.string).to eq "\x83#{term}".b
+      expect(Retf.encode_many([value], byte_lists: true)).to eq [term.bytesize + 1, 131, term].pack('NCa*')
+      expect(Retf.encode([Retf.preencode(value, byte_lists: true)])).to eq [131, 108, 1, term, 106].pack('CCNa*C')
+      expect(Retf.encode_parallel([value], byte_lists: true)).to eq ["\x83#{term}".b]
+    end
+
+    it 'round trips with byte_lists: :array' do
+      value = [[1, 2, 3], { a: [0, 255] }, [], 'abc']
+
+      expect(Retf.decode(Retf.encode(value, byte_lists: true), byte_lists: :array)).to eq value
+    end
+  end
 end
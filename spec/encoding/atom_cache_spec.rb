@@ -0,0 +1,47 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe 'Encoded atom cache' do
+  before { Retf::Native.clear_atom_cache }
+
+  it 'only encodes a repeated symbol once' do
+    encoded = Retf.encode(%i[hello hello hello])
+
+    atom = [119, 5, 'hello'].pack('CCa*')
+
+    expect(encoded).to eq([131, 108, 3].pack('CCN') + (atom * 3) + [106].pack('C'))
+
+    stats = Retf::Native.atom_cache_stats
+
+    expect(stats[:encode_misses]).to eq 1
+    expect(stats[:encode_hits]).to eq 2
+  end
+
+  it 'encodes the same bytes whether or not the symbol is cached' do
+    symbol = :'hello, 世界'
+
+    expect(Retf.encode(symbol)).to eq(Retf.encode(symbol))
+    expect(Retf.encode(symbol).bytes.drop(1)).to eq(symbol.to_etf.bytes)
+  end
+
+  it 'only encodes a struct class name once' do
+    values = [Test::MyClass.new(1, 'a'), Test::MyClass.new(2, 'b')]
+
+    expect(Retf.decode(Retf.encode(values))).to eq(values)
+    expect(Retf::Native.atom_cache_stats[:encode_size]).to eq 3
+  end
+
+  it 'keeps dynamic symbols correct across garbage collection' do
+    expected = Array.new(100) { |i| "dynamic_#{i}".to_sym }.map { Retf.encode(_1) }
+
+    GC.start
+    GC.compact if GC.respond_to?(:compact)
+
+    actual = Array.new(100) { |i| Retf.encode("dynamic_#{i}".to_sym) }
+
+    expect(actual).to eq(expected)
+  end
+end
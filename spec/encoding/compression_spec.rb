@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'retf'
+require 'zlib'
 
 RSpec.describe 'zlib deflated etf' do
   it 'encodes a single float and compresses it' do
@@ -42,4 +43,34 @@ RSpec.describe 'zlib deflated etf' do
 
     expect(compressed_etf).to eq(expected)
   end
+
+  it 'compresses with the given level' do
+    term = 'abc' * 100
+    uncompressed = Retf.encode(term).byteslice(1..)
+
+    compressed_etf = Retf.encode(term, compress: 9)
+
+    expect(compressed_etf).to eq([131, 80, uncompressed.bytesize, Zlib::Deflate.deflate(uncompressed, 9)].pack('CCNa*'))
+    expect(Retf.decode(compressed_etf)).to eq(term)
+  end
+
+  it 'raises an error for an invalid level' do
+    expect { Retf.encode(42, compress: 10) }.to raise_error(ArgumentError)
+  end
+
+  it 'does not compress terms smaller than the threshold' do
+    expect(Retf.encode(3.14, compress: true, compress_threshold: 10)).to eq(Retf.encode(3.14))
+  end
+
+  it 'compresses terms at least as large as the threshold' do
+    expect(Retf.encode(3.14, compress: true, compress_threshold: 9)).to eq(Retf.encode(3.14, compress: true))
+  end
+
+  it 'compresses terms of many megabytes the same way zlib does' do
+    term = Array.new(3) { |i| "#{i} log line\n" * 200_000 }
+    compressed_etf = Retf.encode(term, compress: true)
+
+    expect(Zlib::Inflate.inflate(compressed_etf.byteslice(6..))).to eq(Retf.encode(term).byteslice(1..))
+    expect(compressed_etf.byteslice(2, 4).unpack1('N')).to eq(Retf.encode(term).bytesize - 1)
+  end
 end
@@ -0,0 +1,69 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe Retf::AtomCache do
+  let(:sender) { described_class.new }
+  let(:receiver) { described_class.new }
+
+  let(:message) do
+    [
+      Retf::Tuple[2, :'', Retf::PID.new(1, 2, 3)],
+      { status: :ok, data: [true, false, nil, :ok], struct: Test::MyClass.new(1, 'a') }
+    ]
+  end
+
+  it 'encodes terms which decode with the matching cache' do
+    expect(receiver.decode(sender.encode(*message))).to eq message
+  end
+
+  it 'only sends atom text the first time' do
+    first = sender.encode(*message)
+    second = sender.encode(*message)
+
+    expect(second.bytesize).to be < first.bytesize
+    expect(second).not_to include('status')
+
+    expect(receiver.decode(first)).to eq message
+    expect(receiver.decode(second)).to eq message
+  end
+
+  it 'writes a header with a new entry followed by a reference' do
+    _, _, count, flags, index, length, *rest = sender.encode(:foo).bytes
+    segment = flags & 0b0111
+
+    expect(count).to eq 1
+    expect(flags & 0b1000).to eq 0b1000
+    expect([length, *rest]).to eq [3, *'foo'.bytes, 82, 0]
+
+    expect(sender.encode(:foo).bytes).to eq [131, 68, 1, segment, index, 82, 0]
+  end
+
+  it 'refers to a repeated atom with the same reference' do
+    encoded = sender.encode(%i[foo foo])
+
+    expect(encoded.bytes.last(9)).to eq [108, 0, 0, 0, 2, 82, 0, 82, 0, 106].last(9)
+    expect(receiver.decode(encoded)).to eq [%i[foo foo]]
+  end
+
+  it 'does not remember atoms from a message which failed to encode' do
+    expect { sender.encode([:foo, Object.new]) }.to raise_error(ArgumentError)
+
+    expect(receiver.decode(sender.encode(:foo))).to eq [:foo]
+  end
+
+  it 'spells out atoms once the header is full' do
+    atoms = Array.new(300) { :"atom_#{_1}" }
+
+    expect(receiver.decode(sender.encode(atoms))).to eq [atoms]
+  end
+
+  it 'sends everything again after being cleared' do
+    receiver.decode(sender.encode(:foo))
+    sender.clear
+
+    expect(described_class.new.decode(sender.encode(:foo))).to eq [:foo]
+  end
+end
@@ -0,0 +1,90 @@
+# frozen_string_literal: true
+
+require 'retf'
+require 'stringio'
+
+RSpec.describe 'Retf.encode_to' do
+  # Keeps every call to `write` to check how the output was split up
+  let(:recorder) do
+    Class.new do
+      attr_reader :calls
+
+      def initialize
+        @calls = []
+      end
+
+      def write(*strings)
+        @calls << strings.map(&:dup)
+        strings.sum(&:bytesize)
+      end
+
+      def string
+        @calls.flatten.join
+      end
+    end.new
+  end
+
+  let(:value) do
+    {
+      rows: Array.new(20_000) { |i| { id: i, name: "user #{i}", tags: %i[a b] } },
+      payload: 'x' * 100_000,
+      small: 'abc',
+      big: 2**4000,
+      config: Retf.preencode({ a: [1, 2, 3] })
+    }
+  end
+
+  it 'writes the same bytes as encode' do
+    io = StringIO.new(+'', 'wb')
+    written = Retf.encode_to(io, value)
+
+    expect(io.string).to eq(Retf.encode(value))
+    expect(written).to eq(io.string.bytesize)
+  end
+
+  it 'writes small terms in a single call' do
+    Retf.encode_to(recorder, [1, :two, 'three'])
+
+    expect(recorder.calls.size).to eq(1)
+    expect(recorder.string).to eq(Retf.encode([1, :two, 'three']))
+  end
+
+  it 'writes large terms in bounded pieces' do
+    Retf.encode_to(recorder, value)
+
+    expect(recorder.string).to eq(Retf.encode(value))
+    expect(recorder.calls.size).to be > 1
+    expect(recorder.calls.map { |strings| strings.first.bytesize }.max).to be <= 64 * 1024
+  end
+
+  describe 'with terms much larger than the buffer' do
+    def largest_chunk
+      recorder.calls.map { |strings| strings.first.bytesize }.max
+    end
+
+    {
+      'a multi-MB binary' => 'x' * 5_000_000,
+      'a 1M element array' => Array.new(1_000_000) { |i| i },
+      'a 1M pair map' => Array.new(1_000_000) { |i| [i, i] }.to_h,
+      'a multi-MB integer' => 2**(8 * 3_000_000),
+      'a multi-MB bit binary' => Retf::BitBinary.new('z' * 3_000_000, 3),
+      'a multi-MB pre-encoded term' => Retf.preencode('p' * 3_000_000)
+    }.each do |name, term|
+      it "keeps the buffer bounded for #{name}" do
+        Retf.encode_to(recorder, [term])
+
+        expect(largest_chunk).to be <= 64 * 1024
+        expect(recorder.string).to eq(Retf.encode([term]))
+      end
+    end
+  end
+
+  it 'passes large strings along with the buffer rather than copying them in' do
+    payload = 'y' * 50_000
+    Retf.encode_to(recorder, [:data, payload])
+
+    expect(recorder.calls.first.size).to eq(2)
+    expect(recorder.calls.first.last).to eq(payload)
+    expect(recorder.string).to eq(Retf.encode([:data, payload]))
+  end
+end
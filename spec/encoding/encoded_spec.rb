@@ -0,0 +1,41 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe Retf::Encoded do
+  let(:config) { { topic: 'room:lobby', limits: [1, 2, 3], owner: Retf::Tuple.new(:user, 42) } }
+
+  it 'encodes the same as the value it was made from' do
+    encoded = Retf.preencode(config)
+
+    expect(Retf.encode(encoded)).to eq(Retf.encode(config))
+    expect(encoded.bytesize).to eq(Retf.encode(config).bytesize - 1)
+  end
+
+  it 'is spliced into the terms it is part of' do
+    encoded = Retf.preencode(config)
+    message = [:event, { config: encoded, ref: 1 }]
+
+    expect(Retf.encode(message)).to eq(Retf.encode([:event, { config:, ref: 1 }]))
+    expect(Retf.encode_many([message], packet: 2)).to eq(Retf.encode_many([[:event, { config:, ref: 1 }]], packet: 2))
+  end
+
+  it 'does not pick up changes to the value' do
+    value = { a: 1 }
+    encoded = Retf.preencode(value)
+    value[:b] = 2
+
+    expect(Retf.decode(Retf.encode(encoded))).to eq({ a: 1 })
+  end
+
+  it 'appends itself to a buffer' do
+    encoded = Retf.preencode(:ok)
+
+    expect(encoded.to_etf(+"\x83".b)).to eq(Retf.encode(:ok))
+  end
+
+  it 'is frozen and only made by preencode' do
+    expect(Retf.preencode(1)).to be_frozen
+    expect { described_class.new }.to raise_error(TypeError)
+  end
+end
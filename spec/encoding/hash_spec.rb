@@ -47,4 +47,48 @@ RSpec.describe Hash do
 
     expect(encoded).to eq(expected)
   end
+
+  describe 'arrays of hashes' do
+    # Encodes each hash on its own, as if the
+    # keys of its siblings weren't reused.
+    def encode_each(hashes)
+      body = hashes.map { |hash| Retf.encode(hash).byteslice(1..) }.join
+
+      [131, 108, hashes.size].pack('CCN').b + body + [106].pack('C')
+    end
+
+    it 'encodes hashes which share their keys' do
+      rows = Array.new(3) { |i| { id: i, name: "user #{i}", active: i.even? } }
+
+      expect(Retf.encode(rows)).to eq(encode_each(rows))
+    end
+
+    it 'encodes hashes whose keys differ in part or in order' do
+      rows = [
+        { id: 1, name: 'a' },
+        { id: 2, email: 'b' },
+        { name: 'c', id: 3 },
+        { id: 4, name: 'd', extra: true },
+        { id: 5 },
+        {},
+        { 'id' => 6, name: 'e' },
+        { id: 7, name: 'f' }
+      ]
+
+      expect(Retf.encode(rows)).to eq(encode_each(rows))
+    end
+
+    it 'encodes hashes mixed with other terms' do
+      rows = [{ a: 1 }, :a, { a: 2 }, [{ a: 3 }, { b: 4 }], { a: 5 }]
+
+      expect(Retf.encode(rows)).to eq(encode_each(rows))
+    end
+
+    it 'encodes hashes with more keys than are reused' do
+      keys = Array.new(40) { |i| :"#{'k' * 40}#{i}" }
+      rows = Array.new(3) { |i| keys.to_h { |key| [key, i] } }
+
+      expect(Retf.encode(rows)).to eq(encode_each(rows))
+    end
+  end
 end
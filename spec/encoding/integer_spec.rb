@@ -61,6 +61,18 @@ RSpec.describe Integer do
 
       expect(encoded.bytes).to eq([131, 110, 6, 1, 0, 0, 0, 0, 0, 4])
     end
+
+    it 'encodes a power of two with enough bytes' do
+      encoded = Retf.encode(2**32)
+
+      expect(encoded.bytes).to eq([131, 110, 5, 0, 0, 0, 0, 0, 1])
+    end
+
+    it 'encodes a big integer which fills every byte' do
+      encoded = Retf.encode(-(2**64) + 1)
+
+      expect(encoded.bytes).to eq([131, 110, 8, 1] + Array.new(8, 255))
+    end
   end
 
   describe 'large big integers' do
@@ -0,0 +1,36 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+RSpec.describe 'Retf.encode_many' do
+  let(:values) { [:ok, { a: [1, 2] }, 'binary'] }
+
+  it 'prefixes each value with a 4 byte length by default' do
+    expected = values.map { Retf.encode(_1) }.map { [_1.bytesize, _1].pack('Na*') }.join
+
+    expect(Retf.encode_many(values)).to eq expected
+  end
+
+  it 'supports 1 and 2 byte lengths' do
+    expected = values.map { Retf.encode(_1) }
+
+    expect(Retf.encode_many(values, packet: 1)).to eq(expected.map { [_1.bytesize, _1].pack('Ca*') }.join)
+    expect(Retf.encode_many(values, packet: 2)).to eq(expected.map { [_1.bytesize, _1].pack('na*') }.join)
+  end
+
+  it 'writes values back to back without a packet size' do
+    expect(Retf.encode_many(values, packet: nil)).to eq(values.map { Retf.encode(_1) }.join)
+  end
+
+  it 'returns an empty string for no values' do
+    expect(Retf.encode_many([])).to eq ''
+  end
+
+  it 'raises an ArgumentError if a value is too long for its length' do
+    expect { Retf.encode_many(['a' * 256], packet: 1) }.to raise_error(ArgumentError)
+  end
+
+  it 'rejects unsupported packet sizes' do
+    expect { Retf.encode_many(values, packet: 8) }.to raise_error(ArgumentError, 'packet must be 1, 2 or 4')
+  end
+end
@@ -0,0 +1,86 @@
+# frozen_string_literal: true
+
+require 'retf'
+
+require_relative '../support/test_classes'
+
+RSpec.describe 'Encoding nested terms' do
+  def nest(depth)
+    innermost = []
+    outermost = innermost
+
+    depth.times do
+      outer = [innermost]
+      innermost = outer
+      outermost = outer
+    end
+
+    outermost
+  end
+
+  it 'encodes terms nested deeper than the C stack could hold' do
+    encoded = Retf.encode(nest(200_000))
+
+    expect(encoded.bytesize).to eq(1 + (200_000 * 6) + 1)
+    expect(Retf.encode(Retf.decode(encoded))).to eq(encoded)
+  end
+
+  it 'encodes and decodes deep terms on the smaller stack of a Fiber' do
+    value = nest(100_000)
+
+    decoded = Fiber.new { Retf.decode(Retf.encode(value)) }.resume
+
+    expect(Retf.encode(decoded)).to eq(Retf.encode(value))
+  end
+
+  it 'encodes maps with nested values in order' do
+    value = { a: 1, b: [2, { c: Retf::Tuple.new(3, [4]) }], d: 5, e: { f: 6 } }
+
+    expect(Retf.decode(Retf.encode(value))).to eq(value)
+  end
+
+  it 'encodes the same term in several places' do
+    shared = [1, { a: 2 }]
+
+    expect(Retf.decode(Retf.encode([shared, shared, { b: shared }])))
+      .to eq([shared, shared, { b: shared }])
+  end
+
+  it 'raises on an array which contains itself' do
+    array = [1]
+    array << [array]
+
+    expect { Retf.encode(array) }.to raise_error(ArgumentError, 'cannot encode a term which contains itself')
+  end
+
+  it 'raises on a hash which contains itself' do
+    hash = { a: 1 }
+    hash[:b] = [hash]
+
+    expect { Retf.encode(hash) }.to raise_error(ArgumentError, 'cannot encode a term which contains itself')
+  end
+
+  it 'raises on an object which contains itself' do
+    object = Test::MyClass.new(1, nil)
+    object.b = { object: }
+
+    expect { Retf.encode(object) }.to raise_error(ArgumentError, 'cannot encode a term which contains itself')
+  end
+
+  it 'raises on cycles far below the top' do
+    array = nest(100)
+    innermost = array
+    innermost = innermost[0] until innermost.empty?
+    innermost << array
+
+    expect { Retf.encode(array) }.to raise_error(ArgumentError, 'cannot encode a term which contains itself')
+  end
+
+  it 'limits how deeply terms are nested' do
+    value = [{ a: [Retf::Tuple.new(1, 2)] }]
+
+    expect(Retf.encode(value, max_depth: 4)).to eq(Retf.encode(value))
+    expect { Retf.encode(value, max_depth: 3) }
+      .to raise_error(ArgumentError, 'term is nested deeper than max_depth')
+  end
+end
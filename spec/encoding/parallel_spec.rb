@@ -0,0 +1,59 @@
+# frozen_string_literal: true
+
+require 'retf'
+require 'stringio'
+
+RSpec.describe 'Encoding across Ractors' do
+  let(:values) do
+    Array.new(1000) { |i| { id: i, name: "user #{i}", tags: %i[a b], at: Retf::Tuple.new(i, i * 1.5) } }
+  end
+
+  it 'encodes in Ractors other than the main one' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    term = Ractor.make_shareable([{ a: [1, 2**70, 1.5], 'b' => 'c' }, Retf::Tuple.new(:ok, nil), Retf::Tuple])
+
+    encoded = Ractor.new(term) do |value|
+      io = StringIO.new(+'', 'wb')
+      Retf.encode_to(io, value)
+
+      [Retf.encode(value), Retf.encode(value, compress: true), io.string, Retf.encode_many([value])]
+    end.take
+
+    expect(encoded).to eq([Retf.encode(term), Retf.encode(term, compress: true), Retf.encode(term),
+                           Retf.encode_many([term])])
+  end
+
+  it 'shares preencoded terms between Ractors' do
+    skip 'Ractors are not supported' unless defined?(Ractor)
+
+    preencoded = Retf.preencode({ config: [1, 2, 3] })
+
+    expect(Ractor.shareable?(preencoded)).to be(true)
+    expect(Ractor.new(preencoded) { |config| Retf.encode([:push, config]) }.take)
+      .to eq(Retf.encode([:push, { config: [1, 2, 3] }]))
+  end
+
+  it 'encodes a batch in order' do
+    expect(Retf.encode_parallel(values, workers: 3)).to eq(values.map { |value| Retf.encode(value) })
+  end
+
+  it 'returns frozen strings' do
+    encoded = Retf.encode_parallel(values, workers: 2)
+
+    expect(encoded).to be_frozen
+    expect(encoded).to all(be_frozen)
+  end
+
+  it 'passes options on to encode' do
+    encoded = Retf.encode_parallel(values, workers: 2, compress: true)
+
+    expect(encoded.map { |binary| Retf.decode(binary) }).to eq(values)
+    expect(encoded.first.getbyte(1)).to eq(80)
+  end
+
+  it 'raises the error a value fails to encode with' do
+    expect { Retf.encode_parallel([*values, Object.new], workers: 2) }
+      .to raise_error(ArgumentError, 'object does not respond to `as_etf`')
+  end
+end
@@ -27,4 +27,10 @@ RSpec.describe Retf::PID do
 
     expect(encoded).to eq(expected)
   end
+
+  it 'encodes the same bytes through to_etf' do
+    pid = described_class.new(111, 2, 3, :'nonode@nohost')
+
+    expect([131].pack('C') + pid.to_etf).to eq(Retf.encode(pid))
+  end
 end
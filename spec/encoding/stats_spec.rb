@@ -0,0 +1,123 @@
+# frozen_string_literal: true
+
+require 'retf'
+require 'stringio'
+
+require_relative '../support/test_classes'
+
+RSpec.describe 'Encoding stats' do
+  before do
+    Retf::Native.enable_stats
+    Retf::Native.reset_stats
+  end
+
+  after do
+    Retf::Native.disable_stats
+    Retf::Native.reset_stats
+  end
+
+  def counted_bytes
+    Retf::Native.stats[:encoded].sum { |_tag, counts| counts[:bytes] }
+  end
+
+  it 'counts nothing while disabled' do
+    Retf::Native.disable_stats
+    Retf.encode([1, 'a', :b])
+
+    expect(Retf::Native.stats[:encoded]).to eq({})
+  end
+
+  it 'counts terms and their bytes by tag' do
+    encoded = Retf.encode([1, 'ab', :ok, { a: 2**64 }])
+
+    expect(Retf::Native.stats[:encoded]).to eq(
+      list_ext: { terms: 1, bytes: 5 },
+      small_integer_ext: { terms: 1, bytes: 2 },
+      binary_ext: { terms: 1, bytes: 7 },
+      small_atom_utf8_ext: { terms: 2, bytes: 7 },
+      map_ext: { terms: 1, bytes: 5 },
+      small_big_ext: { terms: 1, bytes: 12 },
+      nil_ext: { terms: 1, bytes: 1 }
+    )
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts the keys copied between hashes of the same shape' do
+    encoded = Retf.encode([{ a: 1, b: 2 }, { a: 3, b: 4 }])
+
+    expect(Retf::Native.stats[:encoded][:small_atom_utf8_ext]).to eq(terms: 4, bytes: 12)
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts as_etf calls and struct names' do
+    encoded = Retf.encode([Test::MyClass.new(1, 'a'), Test::MyClass.new(2, 'b')])
+    stats = Retf::Native.stats
+
+    expect(stats[:as_etf]).to eq 2
+    expect(stats[:encoded][:map_ext]).to eq(terms: 2, bytes: 10)
+    expect(stats[:encoded][:small_atom_utf8_ext][:terms]).to eq 8
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts the terms to_etf methods encode rather than the objects' do
+    klass = Class.new do
+      def to_etf(buffer)
+        Retf::Tuple.new(:custom, 1).to_etf(buffer)
+      end
+    end
+
+    encoded = Retf.encode([klass.new])
+
+    expect(Retf::Native.stats[:encoded].keys).to contain_exactly(:list_ext, :small_tuple_ext, :small_atom_utf8_ext,
+                                                                 :small_integer_ext, :nil_ext)
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts the node of a PID along with it' do
+    pid = Retf::PID.new(1, 2, 3, :'n@h')
+
+    encoded = Retf.encode(pid)
+
+    expect(Retf::Native.stats[:encoded]).to eq(new_pid_ext: { terms: 1, bytes: 18 })
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+
+    Retf::Native.reset_stats
+    encoded = Retf.encode([pid])
+
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts the node of a reference along with it' do
+    encoded = Retf.encode([Retf::Reference.new(1, [2, 3, 4], :'n@h')])
+
+    expect(Retf::Native.stats[:encoded][:newer_reference_ext]).to eq(terms: 1, bytes: 24)
+    expect(counted_bytes).to eq(encoded.bytesize - 1)
+  end
+
+  it 'counts encoded atom cache lookups' do
+    Retf::Native.clear_atom_cache
+    Retf.encode(%i[a a b])
+    stats = Retf::Native.stats
+
+    expect([stats[:encode_atom_cache_hits], stats[:encode_atom_cache_misses]]).to eq([1, 2])
+  end
+
+  it 'counts what was deflated' do
+    encoded = Retf.encode('a' * 100_000, compress: true)
+    deflate = Retf::Native.stats[:deflate]
+
+    expect(deflate.slice(:calls, :bytes_in, :bytes_out)).to eq(calls: 1, bytes_in: 100_005,
+                                                               bytes_out: encoded.bytesize - 6)
+    expect(deflate[:time_ns]).to be_positive
+  end
+
+  it 'counts terms written to an IO across flushes' do
+    io = StringIO.new(+'', 'wb')
+
+    Retf.encode_to(io, [{ data: 'a' * 70_000, more: 'b' * 20 }] * 3)
+
+    expect(Retf::Native.stats[:encoded][:binary_ext]).to eq(terms: 6, bytes: 210_090)
+    expect(Retf::Native.stats[:encoded][:map_ext]).to eq(terms: 3, bytes: 15)
+    expect(counted_bytes).to eq(io.string.bytesize - 1)
+  end
+end
@@ -43,4 +43,14 @@ RSpec.describe String do
 
     expect(encoded.bytes).to eq([131, 109, 0, 0, 0, 10, *str.bytes])
   end
+
+  it 'encodes a string of many megabytes' do
+    str = SecureRandom.bytes(3 << 20)
+
+    encoded = Retf.encode([str])
+
+    expect(encoded.byteslice(0, 7).bytes).to eq([131, 108, 0, 0, 0, 1, 109])
+    expect(encoded.byteslice(11, str.bytesize)).to eq(str)
+    expect(Retf.decode(encoded)).to eq([str])
+  end
 end
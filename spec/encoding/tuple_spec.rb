@@ -30,4 +30,26 @@ RSpec.describe Retf::Tuple do
 
     expect(encoded).to eq(expected)
   end
+
+  it 'encodes a large tuple' do
+    encoded = Retf.encode(described_class.from_array(Array.new(256) { 1 }))
+
+    expect(encoded).to eq([131, 105, 256].pack('CCN') + ([97, 1].pack('CC') * 256))
+  end
+
+  it 'encodes the same bytes through to_etf' do
+    tuple = described_class.new(:ok, 'value')
+
+    expect([131].pack('C') + tuple.to_etf).to eq(Retf.encode(tuple))
+  end
+
+  it 'uses to_etf from subclasses' do
+    subclass = Class.new(described_class) do
+      def to_etf(buffer = ''.b)
+        :overridden.to_etf(buffer)
+      end
+    end
+
+    expect(Retf.encode(subclass.new(1))).to eq(Retf.encode(:overridden))
+  end
 end
@@ -30,4 +30,11 @@ module Test
       self.b = second
     end
   end
+
+  # Hands back the map it's decoded from
+  class PassThrough
+    def self.from_etf(value)
+      value
+    end
+  end
 end